@@ -1,5 +1,25 @@
-:: Compile the shaders
-%~dp0/lib/vulkan/Bin/glslc.exe shaders/shader.vert -o shaders/vert.spv
-%~dp0/lib/vulkan/Bin/glslc.exe shaders/shader.frag -o shaders/frag.spv
+:: Compile the shaders to SPIR-V, as C++ includes embedded in the executable (see EmbeddedShaders.cpp)
+:: Also run as the pre-build step, with nopause
+:: glslc is taken from the Vulkan SDK (VULKAN_SDK) or the PATH. Without it nothing is generated,
+:: the executable then compiles the shaders from their source at runtime.
+setlocal
 
-pause
\ No newline at end of file
+set GLSLC=
+if defined VULKAN_SDK if exist "%VULKAN_SDK%\Bin\glslc.exe" set "GLSLC=%VULKAN_SDK%\Bin\glslc.exe"
+if not defined GLSLC for %%G in (glslc.exe) do if not "%%~$PATH:G"=="" set "GLSLC=%%~$PATH:G"
+
+if not defined GLSLC (
+    echo compile.bat : warning : glslc not found in the Vulkan SDK or the PATH, the shaders are not embedded
+    goto end
+)
+
+if not exist "%~dp0shaders\embedded" mkdir "%~dp0shaders\embedded"
+"%GLSLC%" -O -mfmt=num "%~dp0shaders\shader.vert" -o "%~dp0shaders\embedded\shader.vert.inc" || exit /b 1
+"%GLSLC%" -O -mfmt=num "%~dp0shaders\depth.vert" -o "%~dp0shaders\embedded\depth.vert.inc" || exit /b 1
+"%GLSLC%" -O -mfmt=num "%~dp0shaders\shader.frag" -o "%~dp0shaders\embedded\shader.frag.inc" || exit /b 1
+"%GLSLC%" -O -mfmt=num -DALPHA_TEST=1 "%~dp0shaders\shader.frag" -o "%~dp0shaders\embedded\shader.frag.alpha_test.inc" || exit /b 1
+"%GLSLC%" -O -mfmt=num "%~dp0shaders\cull.comp" -o "%~dp0shaders\embedded\cull.comp.inc" || exit /b 1
+"%GLSLC%" -O -mfmt=num "%~dp0shaders\depthreduce.comp" -o "%~dp0shaders\embedded\depthreduce.comp.inc" || exit /b 1
+
+:end
+if not "%1"=="nopause" pause
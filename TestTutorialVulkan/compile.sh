@@ -1,2 +1,21 @@
-./lib/bin/glslc shaders/shader.vert -o shaders/vert.spv
-./lib/bin/glslc shaders/shader.frag -o shaders/frag.spv
\ No newline at end of file
+# Compile the shaders to SPIR-V, as C++ includes embedded in the executable (see EmbeddedShaders.cpp)
+# glslc is taken from the Vulkan SDK (VULKAN_SDK) or the PATH. Without it nothing is generated,
+# the executable then compiles the shaders from their source at runtime.
+if [ -n "$VULKAN_SDK" ] && [ -x "$VULKAN_SDK/bin/glslc" ]; then
+    GLSLC="$VULKAN_SDK/bin/glslc"
+elif command -v glslc > /dev/null 2>&1; then
+    GLSLC=glslc
+else
+    echo "warning: glslc not found in the Vulkan SDK or the PATH, the shaders are not embedded"
+    exit 0
+fi
+
+set -e
+cd "$(dirname "$0")"
+mkdir -p shaders/embedded
+"$GLSLC" -O -mfmt=num shaders/shader.vert -o shaders/embedded/shader.vert.inc
+"$GLSLC" -O -mfmt=num shaders/depth.vert -o shaders/embedded/depth.vert.inc
+"$GLSLC" -O -mfmt=num shaders/shader.frag -o shaders/embedded/shader.frag.inc
+"$GLSLC" -O -mfmt=num -DALPHA_TEST=1 shaders/shader.frag -o shaders/embedded/shader.frag.alpha_test.inc
+"$GLSLC" -O -mfmt=num shaders/cull.comp -o shaders/embedded/cull.comp.inc
+"$GLSLC" -O -mfmt=num shaders/depthreduce.comp -o shaders/embedded/depthreduce.comp.inc
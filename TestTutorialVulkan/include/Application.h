@@ -1,12 +1,41 @@
 #ifndef __APPLICATION_H__
 #define __APPLICATION_H__
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <vector>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
+#include <unordered_map>
 
 #include "VulkanIncludes.h"
 #include "Vertex.h"
+#include "ShaderManager.h"
+#include "ShaderVariant.h"
+#include "ThreadPool.h"
+#include "PipelineCompiler.h"
+#include "PipelineState.h"
+#include "PipelineStateCache.h"
+#include "LayoutCache.h"
+#include "ShaderReflection.h"
+#include "Frustum.h"
+#include "FrustumCuller.h"
+#include "RenderQueue.h"
+#include "TransformHierarchy.h"
+#include "PresentPolicy.h"
+#include "FrameStats.h"
+#include "TripleBuffer.h"
+#include "RenderGraph.h"
+#include "DynamicResolution.h"
 
 #define PHYSICAL_DEVICE_CHOICE_FIRST_DEVICE
 #define PHYSICAL_DEVICE_CHOICE_RATE_DEVICE
@@ -31,21 +60,240 @@ namespace Vulkan
         std::vector<VkPresentModeKHR> presentModes;
     };
 
+    // Per-frame data
     struct UniformBufferObject
     {
-        alignas(16) glm::mat4 model;
         alignas(16) glm::mat4 view;
         alignas(16) glm::mat4 projection;
     };
 
+    // Per-instance data, std430 layout of Instance in shaders/instance.glsl
+    struct InstanceData
+    {
+        glm::mat4 model;
+        // Local space center, radius
+        glm::vec4 boundingSphere;
+        uint32_t  objectId;
+        uint32_t  batch;
+        uint32_t  padding[2];
+    };
+
+    static_assert(sizeof(InstanceData) == 96, "InstanceData must match the std430 array stride of Instance");
+
+    /*
+     * Two-pass occlusion culling, values match cull.comp
+     * The early pass draws the objects visible last frame, the depth pyramid is built from what it drew,
+     * then the late pass tests every object against the pyramid and draws the ones the early pass missed.
+     */
+    enum CullPass : uint32_t
+    {
+        CULL_PASS_EARLY,
+        CULL_PASS_LATE,
+        CULL_PASS_COUNT
+    };
+
+    // Draws of a render pass, in recording order. The depth pre-pass is toggled per cull pass.
+    enum DrawStage : uint32_t
+    {
+        // Depth only, so the main draws shade each pixel once
+        DRAW_STAGE_DEPTH_PRE_PASS,
+        DRAW_STAGE_MAIN,
+        DRAW_STAGE_COUNT
+    };
+
+    // Layout matches the push_constant block of cull.comp
+    struct CullPushConstants
+    {
+        glm::vec4 frustumPlanes[Frustum::PLANE_COUNT];
+        uint32_t  instanceCount;
+        uint32_t  pass;
+        // First command of the pass in the draw command buffer
+        uint32_t  commandOffset;
+    };
+
+    static_assert(sizeof(CullPushConstants) <= 128, "Only 128 bytes of push constants are guaranteed");
+
+    struct DepthReducePushConstants
+    {
+        // The render extent for level 0, the previous level for the others
+        glm::ivec2 inputSize;
+    };
+
+    // Range of the shared vertex and index buffers
+    struct Mesh
+    {
+        // Identifies the mesh in the render queue keys
+        uint32_t  id;
+        uint32_t  indexCount;
+        uint32_t  firstIndex;
+        int32_t   vertexOffset;
+        // Local space center, radius
+        glm::vec4 boundingSphere;
+    };
+
+    // Farthest depth of the early pass, one mip level per halving of the area
+    struct DepthPyramid
+    {
+        // Transient image of the render graph
+        VkImage        image;
+        // Every level, sampled by the culling pass
+        VkImageView    imageView;
+        // One level each, written by the reduction
+        std::vector<VkImageView> mipImageViews;
+        uint32_t       width;
+        uint32_t       height;
+
+        // Recreated with the pyramid, like the sets referencing its views
+        VkDescriptorPool descriptorPool;
+        // Level i is reduced from level i - 1, level 0 from the depth attachment
+        std::vector<VkDescriptorSet> reduceDescriptorSets;
+        VkDescriptorSet  cullDescriptorSet;
+    };
+
+    // Resources the passes of a frame declare, see CreateRenderGraph
+    struct FrameGraphResources
+    {
+        RenderGraph::Resource swapChainImage;
+        // Rendered at the dynamic resolution, then upscaled to the swap chain image
+        RenderGraph::Resource sceneColor;
+        RenderGraph::Resource depth;
+        RenderGraph::Resource depthPyramid;
+        // Shared by the frames, its content carries over to the next one
+        RenderGraph::Resource visibility;
+        // Halves of the per-frame buffers, one per culling pass
+        std::array<RenderGraph::Resource, CULL_PASS_COUNT> drawCommands;
+        std::array<RenderGraph::Resource, CULL_PASS_COUNT> visibleInstances;
+    };
+
+    // One instance of the render list
+    struct RenderObject
+    {
+        // Node of the transform hierarchy, several objects may share one
+        uint32_t transform;
+        uint32_t objectId;
+        ShaderVariantKey variant;
+        Mesh mesh;
+    };
+
+    // Scene state handed by the simulation thread to the render thread, never modified once published
+    struct FramePacket
+    {
+        uint64_t simulationStep;
+        glm::mat4 view;
+        // Vertical, the projection follows the extent of the swap chain the frame is rendered to
+        float fieldOfView;
+        // Objects to draw and their world matrix, in the same order
+        std::vector<RenderObject> drawList;
+        std::vector<glm::mat4> worldMatrices;
+    };
+
+    // Objects of the render list sharing a shader variant and a mesh, drawn by one instanced indirect draw
+    struct DrawBatch
+    {
+        ShaderVariantKey variant;
+        uint32_t meshId;
+        // instanceCount starts at zero, the culling pass counts the visible instances.
+        // firstInstance is where the batch starts in the visible instance list.
+        VkDrawIndexedIndirectCommand command;
+        uint32_t objectCount;
+    };
+
+    // Everything a frame in flight writes to, reused once the frame timeline has reached the value of the frame
+    struct FrameResources
+    {
+        // Transient pool, reset as a whole at the start of the frame
+        VkCommandPool   commandPool;
+        VkCommandBuffer commandBuffer;
+
+        // One pool per recording task, a pool is never used by two threads at once.
+        // It holds one secondary command buffer per pass and per draw stage :
+        // the buffers of pass p and stage s start at (p * DRAW_STAGE_COUNT + s) * pool count.
+        std::vector<VkCommandPool>   secondaryCommandPools;
+        std::vector<VkCommandBuffer> secondaryCommandBuffers;
+
+        VkBuffer        uniformBuffer;
+        VkDeviceMemory  uniformBufferMemory;
+        // Host coherent, mapped for the lifetime of the buffer
+        void*           uniformBufferMapped;
+        VkDescriptorSet descriptorSet;
+
+        // Filled from the render list every frame, host coherent and mapped as well
+        VkBuffer        instanceBuffer;
+        VkDeviceMemory  instanceBufferMemory;
+        InstanceData*   instances;
+
+        // One command per batch and per pass, its instance count is written by the culling pass
+        VkBuffer        drawCommandBuffer;
+        VkDeviceMemory  drawCommandBufferMemory;
+        // Indices of the visible instances, grouped by pass then by batch, read through gl_InstanceIndex
+        VkBuffer        visibleInstanceBuffer;
+        VkDeviceMemory  visibleInstanceBufferMemory;
+        VkDescriptorSet cullDescriptorSet;
+
+        // Start and end of the commands of the frame, read back once the slot is reused
+        VkQueryPool     timestampQueryPool;
+        bool            hasTimestamps;
+        float           renderScale;
+
+        // Fragment shader invocations of the main draws, one query per pass and per recording task
+        VkQueryPool     statisticsQueryPool;
+        bool            hasStatistics;
+        std::array<bool, CULL_PASS_COUNT> usedDepthPrePass;
+        uint64_t        renderedPixels;
+    };
+
+    // Fragments shaded over the pixels rendered, accumulated between two reports
+    struct OverdrawTotals
+    {
+        uint64_t fragmentCount;
+        uint64_t pixelCount;
+    };
+
+    // Destruction postponed until no frame in flight can still reference the objects
+    struct DeferredDestroy
+    {
+        // Run once the frame timeline reaches it
+        uint64_t timelineValue;
+        std::function<void()> destroy;
+    };
+
     class Application
     {
         static constexpr int WIDTH  { 800 };
         static constexpr int HEIGHT { 600 };
-        static constexpr int MAX_FRAMES_IN_FLIGHT { 2 };
+        // Capacity, the present policy decides how many frames are actually in flight
+        static constexpr int MAX_FRAMES_IN_FLIGHT { 3 };
+        // Host-visible memory used to upload the model, whatever its size
+        static constexpr VkDeviceSize MODEL_STAGING_SIZE { 8 * 1024 * 1024 };
+        // Capacity of the per-frame instance and draw command buffers, only the visible objects are uploaded
+        static constexpr uint32_t MAX_INSTANCES    { 16384 };
+        static constexpr uint32_t MAX_DRAW_BATCHES { 64 };
+        // Capacity of the visibility buffer, indexed by object id
+        static constexpr uint32_t MAX_OBJECTS      { 65536 };
+        // local_size_x of cull.comp
+        static constexpr uint32_t CULL_GROUP_SIZE  { 64 };
+        // local_size_x and local_size_y of depthreduce.comp
+        static constexpr uint32_t DEPTH_REDUCE_GROUP_SIZE { 8 };
+
+        static constexpr float CAMERA_NEAR { 0.1f };
+        static constexpr float CAMERA_FAR  { 10.0f };
 
         const std::string MODEL_PATH   { "media/models/chalet.obj" };
         const std::string TEXTURE_PATH { "media/textures/chalet.jpg" };
+        const std::string PIPELINE_CACHE_PATH { "pipeline_cache.bin" };
+
+        const std::string VERT_SHADER_PATH  { "shaders/shader.vert" };
+        const std::string DEPTH_VERT_SHADER_PATH { "shaders/depth.vert" };
+        const std::string FRAG_SHADER_PATH  { "shaders/shader.frag" };
+        const std::string CULL_SHADER_PATH  { "shaders/cull.comp" };
+        const std::string DEPTH_REDUCE_SHADER_PATH { "shaders/depthreduce.comp" };
+        const std::string SHADER_CACHE_PATH { "shaders/cache" };
+        // Seconds between two checks of the shader sources on disk
+        static constexpr float SHADER_RELOAD_INTERVAL { 0.5f };
+        // Seconds between two reports of the frame stats
+        static constexpr float FRAME_STATS_INTERVAL { 2.0f };
+        // Seconds of GPU work per frame the render scale is adjusted to
+        static constexpr double GPU_FRAME_BUDGET { 1.0 / 60.0 };
 
         // CONSTANTS //
         const std::vector<const char*> _validationLayers
@@ -54,7 +302,8 @@ namespace Vulkan
         };
         const std::vector<const char*> _deviceExtensions
         {
-            VK_KHR_SWAPCHAIN_EXTENSION_NAME
+            VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+            VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME
         };
 
         #ifdef NDEBUG
@@ -74,31 +323,143 @@ namespace Vulkan
         VkQueue _graphicsQueue;
         VkQueue _presentQueue;
 
+        VkPipelineCache _pipelineCache = VK_NULL_HANDLE;
+        bool _isPipelineCacheSeeded = false;
+
         VkSurfaceKHR _surface;
 
-        VkSwapchainKHR       _swapChain;
+        VkSwapchainKHR       _swapChain = VK_NULL_HANDLE;
         std::vector<VkImage> _swapChainImages;
         VkFormat             _swapChainImageFormat;
         VkExtent2D           _swapChainExtent;
+        VkPresentModeKHR     _swapChainPresentMode;
+
+        PresentPolicy _presentPolicy;
+        // Applied between two frames, set from the key callback
+        PresentPolicy _requestedPresentPolicy;
+        uint32_t _framesInFlight;
+        FrameStats _frameStats;
+
+        DynamicResolution _dynamicResolution { GPU_FRAME_BUDGET };
+        // Part of the scene attachments rendered this frame
+        VkExtent2D _renderExtent;
+        // Without timestamps on the graphics queue the scene is always rendered at full resolution
+        bool _hasGpuTimestamps = false;
+        // Nanoseconds per timestamp tick
+        double _timestampPeriod = 0.0;
+        uint64_t _timestampMask = 0;
+        VkFilter _upscaleFilter;
 
         std::vector<VkImageView> _swapChainImageViews;
 
+        // Clears the attachments, draws the early pass. Pipelines and framebuffers are created against it.
         VkRenderPass     _renderPass;
+        // Compatible with _renderPass, loads the attachments for the late pass
+        VkRenderPass     _loadRenderPass;
+        // Owned by the layout cache
         VkDescriptorSetLayout _descriptorSetLayout;
         VkPipelineLayout _pipelineLayout;
-        VkPipeline       _graphicsPipeline;
-
-        std::vector<VkFramebuffer> _swapChainFramebuffers;
-
+        std::unique_ptr<LayoutCache> _layoutCache;
+
+        ShaderManager _shaderManager { SHADER_CACHE_PATH };
+        // Interface of all the shaders, the layouts and the descriptor pool are built from it
+        ShaderReflection _shaderReflection;
+
+        ThreadPool _threadPool;
+        // Separate from the pipeline compilations, a frame never waits behind them
+        ThreadPool _recordingThreadPool;
+        // Smaller chunks of the render list cost more in task overhead than they save
+        static constexpr size_t MIN_DRAWS_PER_RECORDING_TASK { 64 };
+        std::unique_ptr<PipelineCompiler> _pipelineCompiler;
+
+        // Graphics pipelines by state, the ones not created at startup are compiled on first use
+        std::unique_ptr<PipelineStateCache> _pipelineStateCache;
+        ShaderVariantKey _shaderVariant;
+        // Otherwise draws whose pipeline is not compiled yet are skipped
+        bool _isWaitingForPipelines = false;
+
+        // Per cull pass, toggled from the key callback
+        std::array<bool, CULL_PASS_COUNT> _isDepthPrePassEnabled {};
+        // Without the feature the overdraw is not measured
+        bool _hasPipelineStatistics = false;
+        // Indexed by cull pass, then by whether the depth pre-pass ran
+        std::array<std::array<OverdrawTotals, 2>, CULL_PASS_COUNT> _overdrawTotals {};
+
+        // Frustum and occlusion culling on the GPU, writes the indirect draw commands
+        ShaderReflection _cullReflection;
+        // Set 0 holds the buffers of a frame, set 1 the depth pyramid
+        VkDescriptorSetLayout _cullDescriptorSetLayout;
+        VkDescriptorSetLayout _cullPyramidDescriptorSetLayout;
+        VkPipelineLayout _cullPipelineLayout;
+        VkPipeline _cullPipeline = VK_NULL_HANDLE;
+
+        ShaderReflection _depthReduceReflection;
+        VkDescriptorSetLayout _depthReduceDescriptorSetLayout;
+        VkPipelineLayout _depthReducePipelineLayout;
+        VkPipeline _depthReducePipeline = VK_NULL_HANDLE;
+        VkSampler _depthPyramidSampler;
+        DepthPyramid _depthPyramid {};
+
+        // Shared by the frames : each culling pass runs after the previous one on the queue
+        VkBuffer _visibilityBuffer;
+        VkDeviceMemory _visibilityBufferMemory;
+
+        // The scene attachments, at the extent of the swap chain
+        VkImageView _sceneColorImageView;
+        VkFramebuffer _sceneFramebuffer;
+
+        // Only used for the single time commands, the frames record into their own pools
         VkCommandPool _commandPool;
-        std::vector<VkCommandBuffer> _commandBuffers;
 
+        // Transient image of the render graph
         VkImage _depthImage;
-        VkDeviceMemory _depthImageMemory;
         VkImageView _depthImageView;
 
-        std::vector<Vertex> _vertices;
-        std::vector<uint32_t> _indices;
+        // Passes of a frame and the barriers between them, rebuilt with the swap chain
+        std::unique_ptr<RenderGraph> _renderGraph;
+        FrameGraphResources _graphResources {};
+        // What the passes record, set before the graph is executed
+        const FrameResources* _recordingFrame = nullptr;
+
+        // Objects of the scene, owned by the simulation thread once it runs
+        std::vector<RenderObject> _renderList;
+        uint32_t _nextObjectId = 0;
+        // Batches of the objects written to the instance buffer
+        std::vector<DrawBatch> _drawBatches;
+        // One entry per batch, in the order they are recorded and their commands are stored
+        RenderQueue _renderQueue;
+        // Coarse culling on the CPU, the instance buffer only holds the objects in the frustum
+        FrustumCuller _frustumCuller;
+        // Indices in the render list, one per instance written this frame
+        std::vector<uint32_t> _visibleObjects;
+
+        glm::mat4 _view { 1.0f };
+        glm::mat4 _projection { 1.0f };
+
+        // World matrices of the render list, owned by the simulation thread once it runs
+        TransformHierarchy _transforms;
+
+        Mesh _modelMesh {};
+        // Transform node of the model, animated by UpdateScene
+        uint32_t _modelTransform = 0;
+
+        // Publishes packets at its own rate while the render thread records frames.
+        // A packet the render thread has not taken yet is replaced, a frame with no new packet reuses the last one.
+        std::thread _simulationThread;
+        // Wakes the simulation thread to stop, and the render thread waiting on the first packet or an error
+        std::mutex _simulationMutex;
+        std::condition_variable _simulationCondition;
+        bool _isSimulationStopping = false;
+        bool _hasFirstFramePacket = false;
+        // _simulationError is set before the flag, read after it
+        std::atomic<bool> _hasSimulationFailed { false };
+        std::exception_ptr _simulationError;
+        TripleBuffer<FramePacket> _framePackets;
+        // Packet of the frame being recorded, owned by the render thread until the next acquire
+        const FramePacket* _framePacket = nullptr;
+        // Between two packets, independent from the frame rate
+        static constexpr std::chrono::microseconds SIMULATION_STEP { 1000000 / 120 };
+
         VkBuffer _vertexBuffer;
         VkDeviceMemory _vertexBufferMemory;
         VkBuffer _indexBuffer;
@@ -109,16 +470,23 @@ namespace Vulkan
         VkSampler _textureSampler;
 
         VkDescriptorPool _descriptorPool;
-        std::vector<VkDescriptorSet> _descriptorSets;
 
-        std::vector<VkBuffer> _uniformBuffers;
-        std::vector<VkDeviceMemory> _uniformBuffersMemory;
+        std::array<FrameResources, MAX_FRAMES_IN_FLIGHT> _frames {};
 
+        // Binary, the swap chain cannot wait on or signal a timeline semaphore
         std::vector<VkSemaphore> _imageAvailableSemaphores;
         std::vector<VkSemaphore> _renderFinishedSemaphores;
-        std::vector<VkFence> _inFlightFences;
-        std::vector<VkFence> _imagesInFlight;
+        // Signaled to n + 1 by the submission of frame n : everything reused across frames waits on it
+        VkSemaphore _frameTimeline;
+        // Value signaled by the last frame rendering to each swap chain image, 0 if none
+        std::vector<uint64_t> _imageTimelineValues;
+        PFN_vkWaitSemaphoresKHR _vkWaitSemaphores = nullptr;
+        PFN_vkGetSemaphoreCounterValueKHR _vkGetSemaphoreCounterValue = nullptr;
         size_t _currentFrame = 0;
+        // Number of frames submitted so far, the last value the frame timeline will reach
+        uint64_t _frameNumber = 0;
+
+        std::deque<DeferredDestroy> _deferredDestroys;
 
         bool _isFramebufferResized = false;
 
@@ -158,25 +526,61 @@ namespace Vulkan
         // ==== Logical Device ==== //
         void CreateLogicalDevice();
 
+        // ==== Pipeline Cache ==== //
+        void CreatePipelineCache();
+        void SavePipelineCache();
+        bool IsPipelineCacheCompatible(const std::vector<char>& data);
+
         // ==== Swap Chain ==== //
         void CreateSwapChain();
         VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
         VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
+        // Enough images for the frames in flight to never wait on the presentation engine
+        uint32_t ChooseSwapImageCount(const VkSurfaceCapabilitiesKHR& capabilities, VkPresentModeKHR presentMode);
         VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 
         // ==== Image View ==== //
         void CreateImageViews();
 
         // ==== Descriptor Set Layout ==== //
+        void ReflectShaders();
         void CreateDescriptorSetLayout();
 
         // ==== Graphics Pipeline ==== //
-        void CreateGraphicsPipeline();
-        VkShaderModule CreateShaderModule(const std::vector<char>& code);
+        void CreatePipelineLayout();
+        void CreateGraphicsPipelines();
+        GraphicsPipelineDescription DescribeGraphicsPipeline(const PipelineStateKey& state, std::vector<std::string>& shaders);
+        PipelineStateKey MakePipelineState(const ShaderVariantKey& variant);
+        // Shared by every opaque batch, writes the depth only
+        PipelineStateKey MakeDepthPrePassState();
+        // Shades the fragments at the depth of the pre-pass, without writing it
+        PipelineStateKey MakeDepthEqualState(const ShaderVariantKey& variant);
+        void DestroyPipelines(const std::vector<std::shared_future<VkPipeline>>& pipelines, bool isDeferred);
+
+        // ==== Culling ==== //
+        void CreateCullPipelineLayout();
+        void CreateCullPipeline();
+        VkPipeline CreateComputePipeline(const std::string& shaderPath, VkPipelineLayout layout);
+        void CreateVisibilityBuffer();
+
+        // ==== Depth Pyramid ==== //
+        void CreateDepthReducePipelineLayout();
+        void CreateDepthReducePipeline();
+        void CreateDepthPyramidSampler();
+        RenderGraphImageDescription DescribeDepthPyramid();
+        // Depends on the swap chain extent, rebuilt with it
+        void CreateDepthPyramid();
+        void DestroyDepthPyramid(const DepthPyramid& depthPyramid);
 
         // ==== Render Pass ==== //
         void CreateRenderPass();
 
+        // ==== Render Graph ==== //
+        // Creates the transient images, before the views and framebuffers referencing them
+        void CreateRenderGraph();
+        // Linear when the format supports it, throws if it cannot be blitted at all
+        VkFilter ChooseUpscaleFilter(VkFormat format);
+
         // ==== Framebuffers ==== //
         void CreateFramebuffers();
 
@@ -202,7 +606,8 @@ namespace Vulkan
             VkImageUsageFlags usage,
             VkMemoryPropertyFlags properties,
             VkImage& image,
-            VkDeviceMemory& imageMemory);
+            VkDeviceMemory& imageMemory,
+            uint32_t mipLevels = 1);
         void TransitionImageLayout(
             VkImage image, 
             VkFormat format, 
@@ -212,55 +617,119 @@ namespace Vulkan
         void CreateTextureImageView();
         void CreateTextureSampler();
 
-        VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) ;
+        VkImageView CreateImageView(
+            VkImage image,
+            VkFormat format,
+            VkImageAspectFlags aspectFlags,
+            uint32_t baseMipLevel = 0,
+            uint32_t levelCount = 1);
 
         // ==== Descriptor Sets ==== //
         void CreateDescriptorSets();
 
         // ==== Model Loading ==== //
+        // Streams the model straight into the vertex and index buffers
         void LoadModel();
 
-        // ==== Buffers ==== //
-        // ==== Vertex Buffer ==== //
-        void CreateVertexBuffer();
-
-        // ==== Index Buffer ==== //
-        void CreateIndexBuffer();
+        // ==== Scene ==== //
+        void CreateScene();
+        // Adds one copy of the mesh per transform node to the render list, returns the render list index of the first.
+        // All the copies are drawn by a single instanced draw.
+        size_t SpawnInstances(const Mesh& mesh, const ShaderVariantKey& variant, const std::vector<uint32_t>& transforms);
 
+        // ==== Buffers ==== //
         // ==== Uniform Buffer ==== //
         void CreateUniformBuffer();
+        void CreateInstanceBuffers();
 
         void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
         uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
-        void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+        void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0);
 
         // ==== Descriptor Pool ==== //
         void CreateDescriptorPool();
 
         // ==== Command Buffers ==== //
         void CreateCommandBuffers();
+        // GPU time of the frames, and their overdraw when pipeline statistics are supported
+        void CreateQueryPools();
+        void RecordCommandBuffer(const FrameResources& frame, uint32_t imageIndex);
+        // Writes the draw commands of both passes, with no instance yet
+        void RecordCommandReset(VkCommandBuffer commandBuffer, const FrameResources& frame);
+        void RecordCulling(VkCommandBuffer commandBuffer, const FrameResources& frame, CullPass pass);
+        void RecordDepthPyramid(VkCommandBuffer commandBuffer);
+        // One render pass, its draws recorded in parallel into secondary command buffers
+        void RecordDrawPass(VkCommandBuffer commandBuffer, const FrameResources& frame, CullPass pass);
+        // Blits the rendered part of the scene over the whole swap chain image
+        void RecordUpscale(VkCommandBuffer commandBuffer, VkImage swapChainImage);
+        void RecordDraws(
+            VkCommandBuffer commandBuffer,
+            VkFramebuffer framebuffer,
+            const FrameResources& frame,
+            CullPass pass,
+            DrawStage stage,
+            uint32_t task,
+            size_t firstDraw,
+            size_t lastDraw);
         VkCommandBuffer BeginSingleTimeCommands();
         void EndSingleTimeCommands(VkCommandBuffer commandBuffer);
 
         // ==== Semaphores ==== //
         void CreateSyncObjects();
+        // Blocks until the frame timeline reaches the value
+        void WaitForTimeline(uint64_t value);
+        uint64_t GetCompletedTimelineValue();
         #pragma endregion //Initialization
 
+        // Only the extent-dependent objects are rebuilt on resize
         void RecreateSwapChain();
         void CleanupSwapChain();
+        void CleanupFrameResources();
+
+        void DeferDestroy(std::function<void()> destroy);
+        void FlushDeferredDestroys(bool isDeviceIdle);
 
         #pragma region MainLoop
         void MainLoop();
 
         void DrawFrame();
-        void UpdateUniformBuffer(uint32_t currentImage);
+        // Waits for the simulation to publish a packet newer than the last one
+        const FramePacket& AcquireFramePacket();
+        void UpdateCamera(const FramePacket& packet);
+        // Waits for the frames in flight, then recreates the swap chain for the new present mode
+        void ApplyPresentPolicy(PresentPolicy policy);
+        void PrintPresentPolicy();
+        // Feeds the GPU time of the frame last recorded in this slot to the dynamic resolution
+        void ReadFrameTime(FrameResources& frame);
+        void PrintDynamicResolution();
+        // Accumulates the fragment shader invocations of the frame last recorded in this slot
+        void ReadOverdraw(FrameResources& frame);
+        void PrintOverdraw();
+        void ToggleDepthPrePass(CullPass pass);
+        void ReloadChangedShaders();
+        void UpdateInstanceBuffer(FrameResources& frame);
+        // Sorts the batches, returns the command slot of each of them
+        std::vector<uint32_t> BuildRenderQueue(const FrameResources& frame, const std::vector<glm::vec2>& batchDepths);
+        void UpdateUniformBuffer(FrameResources& frame);
         #pragma endregion //MainLoop
 
+        #pragma region Simulation
+        void StartSimulation();
+        void StopSimulation();
+        void SimulationLoop();
+        // Animates the scene at time seconds since the start, writes its state to the packet
+        void UpdateScene(float time, FramePacket& packet);
+        #pragma endregion //Simulation
+
         #pragma region Cleanup
         void Cleanup();
         #pragma endregion //Cleanup
 
     public:
+        explicit Application(PresentPolicy presentPolicy = PRESENT_POLICY_VSYNC);
+        // Stops the simulation thread if the main loop was left by an exception
+        ~Application();
+
         void Run();
 
         static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(
@@ -271,10 +740,13 @@ namespace Vulkan
 
         static std::vector<char> ReadFile(const std::string& filename);
         static void FrameBufferResizeCallback(GLFWwindow* window, int width, int height);
+        // F1 low latency, F2 throughput, F3 vsync, F5 and F6 depth pre-pass of the early and late passes
+        static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 
         // ==== Accessors ==== //
         inline bool& IsFramebufferResized()       { return _isFramebufferResized; }
         inline bool  IsFramebufferResized() const { return _isFramebufferResized; }
+        inline void RequestPresentPolicy(PresentPolicy policy) { _requestedPresentPolicy = policy; }
     };
 }
 
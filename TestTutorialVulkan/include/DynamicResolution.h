@@ -0,0 +1,58 @@
+#ifndef __DYNAMIC_RESOLUTION_H__
+#define __DYNAMIC_RESOLUTION_H__
+
+#include <cstdint>
+
+#include "VulkanIncludes.h"
+
+namespace Vulkan
+{
+    /*
+     * Render scale of the scene, adjusted from the GPU time of the completed frames against a budget
+     * The time is smoothed, quickly when it rises and slowly when it falls : a load spike lowers the
+     * scale within a frame or two, the scale only goes back up once the frames have stayed well under
+     * the budget for a while. Between the two thresholds the scale is left alone.
+     * The GPU time is assumed proportional to the rendered area, the scale to its square root.
+     */
+    class DynamicResolution
+    {
+    public:
+        static constexpr float MIN_SCALE { 0.5f };
+        static constexpr float MAX_SCALE { 1.0f };
+
+    private:
+        // Fraction of the budget aimed at, and the thresholds around it
+        static constexpr double TARGET_RATIO    { 0.85 };
+        static constexpr double DOWNSCALE_RATIO { 0.95 };
+        static constexpr double UPSCALE_RATIO   { 0.75 };
+        // Frames under the upscale threshold before the scale goes up
+        static constexpr uint32_t UPSCALE_DELAY { 30 };
+        // Largest increase of the scale at once, a decrease is not limited
+        static constexpr float MAX_UPSCALE_STEP { 0.05f };
+        // Weight of a new time in the smoothed one
+        static constexpr double RISE_SMOOTHING { 0.5 };
+        static constexpr double FALL_SMOOTHING { 0.1 };
+
+        double _frameBudget;
+        float _scale = MAX_SCALE;
+        // At the current scale, 0 until the first frame
+        double _smoothedTime = 0.0;
+        uint32_t _framesUnderBudget = 0;
+
+    public:
+        // In seconds
+        explicit DynamicResolution(double frameBudget);
+
+        // GPU time of a completed frame, rendered at renderScale
+        void AddFrameTime(double gpuTime, float renderScale);
+
+        // Rounded so the scale applies to both sides, at least 1 pixel
+        VkExtent2D GetRenderExtent(VkExtent2D extent) const;
+
+        inline float GetScale() const { return _scale; }
+        inline double GetSmoothedTime() const { return _smoothedTime; }
+        inline double GetFrameBudget() const { return _frameBudget; }
+    };
+}
+
+#endif// __DYNAMIC_RESOLUTION_H__
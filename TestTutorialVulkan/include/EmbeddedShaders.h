@@ -0,0 +1,28 @@
+#ifndef __EMBEDDED_SHADERS_H__
+#define __EMBEDDED_SHADERS_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Vulkan
+{
+    /*
+     * SPIR-V compiled by compile.bat / compile.sh (the pre-build step) and linked into the executable
+     * Looked up with the same key as ShaderManager::MakeKey, i.e. "shaders/shader.frag|ALPHA_TEST=1"
+     */
+    struct EmbeddedShader
+    {
+        const char* key;
+        const uint32_t* words;
+        size_t wordCount;
+    };
+
+    // False if the project was built without running the shader compilation step
+    bool HasEmbeddedShaders();
+
+    // nullptr if this shader variant was not embedded
+    const EmbeddedShader* FindEmbeddedShader(const std::string& key);
+}
+
+#endif// __EMBEDDED_SHADERS_H__
@@ -0,0 +1,65 @@
+#ifndef __FRAME_STATS_H__
+#define __FRAME_STATS_H__
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <ostream>
+
+#include "PresentPolicy.h"
+
+namespace Vulkan
+{
+    /*
+     * Latency and throughput of the frames, accumulated per present policy
+     * The latency of a frame runs from the start of its CPU work to the completion of its commands,
+     * as seen by the CPU when it checks the frame timeline : presentation and scanout are not included.
+     * The throughput only counts the time between frames rendered under the same policy.
+     */
+    class FrameStats
+    {
+        using Clock = std::chrono::steady_clock;
+
+        struct PendingFrame
+        {
+            uint64_t timelineValue;
+            PresentPolicy policy;
+            Clock::time_point startTime;
+        };
+
+        struct Totals
+        {
+            uint64_t frameCount = 0;
+            double seconds = 0.0;
+            uint64_t completedCount = 0;
+            double latencySum = 0.0;
+            double latencyMax = 0.0;
+        };
+
+        // Submitted, in timeline order
+        std::deque<PendingFrame> _pendingFrames;
+        std::array<Totals, PRESENT_POLICY_COUNT> _totals {};
+        // Since the last interval report
+        std::array<Totals, PRESENT_POLICY_COUNT> _intervalTotals {};
+
+        std::optional<Clock::time_point> _lastStartTime;
+        PresentPolicy _lastPolicy = PRESENT_POLICY_COUNT;
+
+        static void Print(std::ostream& stream, PresentPolicy policy, const Totals& totals);
+
+    public:
+        // CPU work of the frame signaling timelineValue starts, it must be submitted
+        void BeginFrame(uint64_t timelineValue, PresentPolicy policy);
+        // Every frame up to completedValue is done
+        void CompleteFrames(uint64_t completedValue);
+
+        // Prints then resets the stats since the last call
+        void ReportInterval(std::ostream& stream);
+        // Prints the stats since startup, one line per policy used
+        void ReportTotals(std::ostream& stream) const;
+    };
+}
+
+#endif// __FRAME_STATS_H__
@@ -0,0 +1,57 @@
+#ifndef __FRUSTUM_H__
+#define __FRUSTUM_H__
+
+#include <array>
+
+#include <glm/glm.hpp>
+
+namespace Vulkan
+{
+    /*
+     * View frustum as six planes, normals pointing inside (ax + by + cz + d >= 0 for visible points)
+     * Extracted from the clip space bounds of projection * view (Gribb & Hartmann),
+     * with the 0..w clip depth of GLM_FORCE_DEPTH_ZERO_TO_ONE.
+     */
+    struct Frustum
+    {
+        enum Plane
+        {
+            PLANE_LEFT,
+            PLANE_RIGHT,
+            PLANE_BOTTOM,
+            PLANE_TOP,
+            PLANE_NEAR,
+            PLANE_FAR,
+            PLANE_COUNT
+        };
+
+        std::array<glm::vec4, PLANE_COUNT> planes;
+
+        static Frustum FromMatrix(const glm::mat4& viewProjection)
+        {
+            // glm matrices are column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+            auto row = [&](int i)
+            {
+                return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+            };
+
+            Frustum frustum {};
+            frustum.planes[PLANE_LEFT]   = row(3) + row(0);
+            frustum.planes[PLANE_RIGHT]  = row(3) - row(0);
+            frustum.planes[PLANE_BOTTOM] = row(3) + row(1);
+            frustum.planes[PLANE_TOP]    = row(3) - row(1);
+            frustum.planes[PLANE_NEAR]   = row(2);
+            frustum.planes[PLANE_FAR]    = row(3) - row(2);
+
+            // Normalized, so the distance to a plane can be compared with a radius
+            for (glm::vec4& plane : frustum.planes)
+            {
+                plane /= glm::length(glm::vec3(plane));
+            }
+
+            return frustum;
+        }
+    };
+}
+
+#endif// __FRUSTUM_H__
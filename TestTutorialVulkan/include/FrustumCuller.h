@@ -0,0 +1,48 @@
+#ifndef __FRUSTUM_CULLER_H__
+#define __FRUSTUM_CULLER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+#include "ThreadPool.h"
+
+namespace Vulkan
+{
+    /*
+     * World space bounding spheres tested against a frustum, four at a time
+     * Stored as structure of arrays (all the x, all the y, ...) so one SSE register holds a component
+     * of four spheres. The arrays are padded to a multiple of SPHERES_PER_TEST, the tail is never visible.
+     */
+    class FrustumCuller
+    {
+        std::vector<float> _centersX;
+        std::vector<float> _centersY;
+        std::vector<float> _centersZ;
+        std::vector<float> _radii;
+        size_t _count = 0;
+
+        // Visible spheres of [first, last), first a multiple of SPHERES_PER_TEST
+        void CullRange(const Frustum& frustum, size_t first, size_t last, std::vector<uint32_t>& visible) const;
+
+    public:
+        static constexpr size_t SPHERES_PER_TEST { 4 };
+        // Smaller ranges cost more in task overhead than they save
+        static constexpr size_t MIN_SPHERES_PER_TASK { 4096 };
+
+        void Resize(size_t count);
+        void SetSphere(size_t index, const glm::vec3& center, float radius);
+
+        // Indices of the spheres intersecting the frustum, in increasing order
+        void Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+        // Same, large sets are split across the workers of the pool
+        void Cull(const Frustum& frustum, ThreadPool& threadPool, std::vector<uint32_t>& visible) const;
+
+        inline size_t GetSize() const { return _count; }
+    };
+}
+
+#endif// __FRUSTUM_CULLER_H__
@@ -0,0 +1,61 @@
+#ifndef __LAYOUT_CACHE_H__
+#define __LAYOUT_CACHE_H__
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "VulkanIncludes.h"
+
+namespace Vulkan
+{
+    /*
+     * Descriptor set layouts and pipeline layouts, deduplicated by content
+     * Identical layouts share one handle, so a handle can stand for its content in the
+     * PipelineStateKey and in the pipeline layout keys below.
+     * Layouts live until Destroy(), they are cheap and few.
+     */
+    class LayoutCache
+    {
+        struct DescriptorSetLayoutKey
+        {
+            // Sorted by binding number
+            std::vector<VkDescriptorSetLayoutBinding> bindings;
+
+            bool operator==(const DescriptorSetLayoutKey& other) const;
+            size_t Hash() const;
+        };
+
+        struct PipelineLayoutKey
+        {
+            std::vector<VkDescriptorSetLayout> setLayouts;
+            std::vector<VkPushConstantRange> pushConstantRanges;
+
+            bool operator==(const PipelineLayoutKey& other) const;
+            size_t Hash() const;
+        };
+
+        template<typename Key>
+        struct KeyHash
+        {
+            size_t operator()(const Key& key) const { return key.Hash(); }
+        };
+
+        VkDevice _device;
+
+        std::unordered_map<DescriptorSetLayoutKey, VkDescriptorSetLayout, KeyHash<DescriptorSetLayoutKey>> _descriptorSetLayouts;
+        std::unordered_map<PipelineLayoutKey, VkPipelineLayout, KeyHash<PipelineLayoutKey>> _pipelineLayouts;
+
+    public:
+        explicit LayoutCache(VkDevice device);
+
+        VkDescriptorSetLayout GetDescriptorSetLayout(std::vector<VkDescriptorSetLayoutBinding> bindings);
+        VkPipelineLayout GetPipelineLayout(
+            const std::vector<VkDescriptorSetLayout>& setLayouts,
+            const std::vector<VkPushConstantRange>& pushConstantRanges = {});
+
+        void Destroy();
+    };
+}
+
+#endif// __LAYOUT_CACHE_H__
@@ -0,0 +1,115 @@
+#ifndef __OBJ_STREAM_READER_H__
+#define __OBJ_STREAM_READER_H__
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Vertex.h"
+
+namespace Vulkan
+{
+    /*
+     * Streaming Wavefront OBJ reader
+     * The file is walked in fixed-size chunks and never held in memory as a whole.
+     * Deduplicated vertices and indices are written into caller-owned batches (i.e. mapped
+     * staging memory) and handed to a sink every time a batch is full.
+     *
+     * Faces address positions and texcoords randomly, so those two attribute arrays are
+     * spilled to temporary files by Scan() and read back by index through a small page cache.
+     * Host memory is fixed-size whatever the model.
+     */
+    class ObjStreamReader
+    {
+        static constexpr size_t CHUNK_SIZE       { 1 << 16 };
+        static constexpr size_t VERTEX_CACHE_BITS { 16 };
+        static constexpr size_t VERTEX_CACHE_SIZE { size_t(1) << VERTEX_CACHE_BITS };
+
+    public:
+        struct Counts
+        {
+            uint32_t positions = 0;
+            uint32_t texcoords = 0;
+            uint32_t vertices  = 0;
+            uint32_t indices   = 0;
+        };
+
+        // Called with the number of elements written to the front of the batch
+        using Sink = std::function<void(size_t count)>;
+
+    private:
+        // Direct-mapped (position, texcoord) -> vertex index cache.
+        // Collisions overwrite the entry, so a vertex may occasionally be emitted twice,
+        // but the table never grows. The policy is deterministic: Scan() and Stream() agree.
+        struct CacheEntry
+        {
+            uint64_t key   = 0;
+            uint32_t index = 0;
+        };
+
+        // Fixed-stride float records written once, then read back by index.
+        // Pages of records are kept in a direct-mapped cache, faces mostly address nearby records.
+        class AttributeSpill
+        {
+            static constexpr uint32_t PAGE_RECORDS { 1024 };
+            static constexpr uint32_t CACHE_PAGES  { 64 };
+
+            std::filesystem::path _path;
+            std::fstream _file;
+            uint32_t _stride;
+            uint32_t _count = 0;
+
+            std::vector<float> _pages;
+            // Page index + 1 held by each cache slot, 0 when empty
+            std::vector<uint32_t> _pageTags;
+
+        public:
+            explicit AttributeSpill(uint32_t stride);
+            ~AttributeSpill();
+
+            // Creates or truncates the temporary file
+            void Open(const std::filesystem::path& path);
+            void Append(const float* record);
+            const float* Get(uint32_t index);
+            // Removes the temporary file
+            void Close();
+
+            inline uint32_t GetCount() const { return _count; }
+        };
+
+        std::string _filename;
+
+        std::vector<char> _chunk;
+        std::vector<CacheEntry> _vertexCache;
+
+        AttributeSpill _positions { 3 };
+        AttributeSpill _texcoords { 2 };
+
+        Counts _counts;
+        bool   _isScanned = false;
+
+        template<typename LineFn>
+        void ForEachLine(LineFn&& fn);
+
+        template<typename CornerFn>
+        void ParseFace(char* line, uint32_t positionCount, uint32_t texcoordCount, CornerFn&& fn);
+
+        bool FindOrInsert(int32_t positionIndex, int32_t texcoordIndex, uint32_t& vertexCount, uint32_t& index);
+
+    public:
+        explicit ObjStreamReader(const std::string& filename);
+
+        // First pass: counts unique vertices and indices so the GPU buffers can be sized exactly
+        const Counts& Scan();
+
+        // Second pass: writes vertices and indices in batches of at most the given capacities
+        void Stream(
+            Vertex*   vertexBatch, size_t vertexCapacity, const Sink& vertexSink,
+            uint32_t* indexBatch,  size_t indexCapacity,  const Sink& indexSink);
+    };
+}
+
+#endif// __OBJ_STREAM_READER_H__
@@ -0,0 +1,89 @@
+#ifndef __PIPELINE_COMPILER_H__
+#define __PIPELINE_COMPILER_H__
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "VulkanIncludes.h"
+#include "ThreadPool.h"
+#include "ShaderManager.h"
+
+namespace Vulkan
+{
+    struct ShaderStageDescription
+    {
+        VkShaderStageFlagBits stage;
+        // Shared with the shader manager or embedded, never copied
+        ShaderCode code;
+        std::string entryPoint = "main";
+
+        // Raw values of the specialization constants, empty if the stage has none
+        std::vector<VkSpecializationMapEntry> specializationMapEntries;
+        std::vector<uint8_t> specializationData;
+    };
+
+    /*
+     * Everything needed to create a graphics pipeline, owned by value so it can be handed to
+     * a worker thread. The pointer members of the Vulkan state structs are ignored, they are
+     * set from the vectors when the pipeline is compiled.
+     */
+    struct GraphicsPipelineDescription
+    {
+        std::vector<ShaderStageDescription> stages;
+
+        std::vector<VkVertexInputBindingDescription> vertexBindings;
+        std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly {};
+        VkPipelineRasterizationStateCreateInfo rasterizer {};
+        VkPipelineMultisampleStateCreateInfo multisampling {};
+        VkPipelineDepthStencilStateCreateInfo depthStencil {};
+
+        VkPipelineColorBlendStateCreateInfo colorBlending {};
+        std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments;
+
+        // Viewport and scissor count, their values are expected to be dynamic
+        uint32_t viewportCount = 1;
+        std::vector<VkDynamicState> dynamicStates;
+
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        uint32_t subpass = 0;
+
+        // Only used in the log
+        std::string name;
+    };
+
+    /*
+     * Creates graphics pipelines on a worker pool
+     * vkCreateGraphicsPipelines can be called from several threads on the same device,
+     * and a VkPipelineCache is internally synchronized, so every worker shares one cache.
+     * The layouts and render passes referenced by a description must outlive its future.
+     */
+    class PipelineCompiler
+    {
+        VkDevice _device;
+        VkPipelineCache _pipelineCache;
+        ThreadPool& _threadPool;
+
+    public:
+        PipelineCompiler(VkDevice device, VkPipelineCache pipelineCache, ThreadPool& threadPool);
+
+        // The future rethrows if the pipeline could not be created
+        std::shared_future<VkPipeline> Submit(GraphicsPipelineDescription description);
+        std::vector<std::shared_future<VkPipeline>> Submit(std::vector<GraphicsPipelineDescription> descriptions);
+
+        // Synchronous creation, what the workers run
+        static VkPipeline Compile(VkDevice device, VkPipelineCache pipelineCache, const GraphicsPipelineDescription& description);
+
+        static inline bool IsReady(const std::shared_future<VkPipeline>& pipeline)
+        {
+            return pipeline.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+    };
+}
+
+#endif// __PIPELINE_COMPILER_H__
@@ -0,0 +1,108 @@
+#ifndef __PIPELINE_STATE_H__
+#define __PIPELINE_STATE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+
+#include "VulkanIncludes.h"
+#include "ShaderVariant.h"
+
+namespace Vulkan
+{
+    enum BlendMode : uint8_t
+    {
+        BLEND_MODE_OPAQUE,
+        // finalColor.rgb = newAlpha * newColor + (1 - newAlpha) * oldColor
+        BLEND_MODE_ALPHA,
+        BLEND_MODE_ADDITIVE,
+    };
+
+    enum VertexLayout : uint8_t
+    {
+        // Vertex : position, color, texture coordinates
+        VERTEX_LAYOUT_STANDARD,
+    };
+
+    /*
+     * Full description of a graphics pipeline
+     * Plain data without implicit padding : two keys are equal when their bytes are equal,
+     * which is also what the hash reads. Always start from a value-initialized key.
+     * Layouts come from the LayoutCache, so identical layouts share one handle.
+     */
+    struct PipelineStateKey
+    {
+        VkPipelineLayout layout     = VK_NULL_HANDLE;
+        VkRenderPass     renderPass = VK_NULL_HANDLE;
+        uint32_t         subpass    = 0;
+
+        // Shader permutation, see ShaderVariantKey
+        uint32_t shaderFeatures = SHADER_FEATURE_TEXTURED | SHADER_FEATURE_VERTEX_COLOR;
+        float    alphaCutoff    = 0.5f;
+
+        uint8_t vertexLayout   = VERTEX_LAYOUT_STANDARD;
+        uint8_t topology       = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        uint8_t polygonMode    = VK_POLYGON_MODE_FILL;
+        uint8_t cullMode       = VK_CULL_MODE_BACK_BIT;
+        uint8_t frontFace      = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        uint8_t depthTest      = VK_TRUE;
+        uint8_t depthWrite     = VK_TRUE;
+        uint8_t depthCompareOp = VK_COMPARE_OP_LESS;
+        uint8_t blendMode      = BLEND_MODE_OPAQUE;
+        uint8_t colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        uint8_t sampleCount    = VK_SAMPLE_COUNT_1_BIT;
+        uint8_t padding[1]     = {};
+
+        ShaderVariantKey GetShaderVariant() const
+        {
+            ShaderVariantKey variant {};
+            variant.features = shaderFeatures;
+            variant.alphaCutoff = alphaCutoff;
+            return variant;
+        }
+
+        void SetShaderVariant(const ShaderVariantKey& variant)
+        {
+            shaderFeatures = variant.features;
+            alphaCutoff = variant.alphaCutoff;
+        }
+
+        bool operator==(const PipelineStateKey& other) const
+        {
+            return memcmp(this, &other, sizeof(PipelineStateKey)) == 0;
+        }
+
+        // FNV-1a over the bytes of the key
+        uint64_t Hash() const
+        {
+            const unsigned char* bytes { reinterpret_cast<const unsigned char*>(this) };
+
+            uint64_t hash { 0xcbf29ce484222325ull };
+            for (size_t i = 0; i < sizeof(PipelineStateKey); ++i)
+            {
+                hash ^= bytes[i];
+                hash *= 0x100000001b3ull;
+            }
+            return hash;
+        }
+    };
+
+    static_assert(std::is_trivially_copyable<PipelineStateKey>::value, "PipelineStateKey must stay plain data");
+    static_assert(sizeof(PipelineStateKey) == 2 * sizeof(VkPipelineLayout) + 3 * sizeof(uint32_t) + 12,
+                  "PipelineStateKey must not contain implicit padding");
+}
+
+namespace std
+{
+    template<> struct hash<Vulkan::PipelineStateKey>
+    {
+        size_t operator()(Vulkan::PipelineStateKey const& key) const
+        {
+            return static_cast<size_t>(key.Hash());
+        }
+    };
+}
+
+#endif// __PIPELINE_STATE_H__
@@ -0,0 +1,62 @@
+#ifndef __PIPELINE_STATE_CACHE_H__
+#define __PIPELINE_STATE_CACHE_H__
+
+#include <functional>
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "VulkanIncludes.h"
+#include "PipelineState.h"
+#include "PipelineCompiler.h"
+
+namespace Vulkan
+{
+    /*
+     * Graphics pipelines looked up by their full state
+     * A state is compiled once, on the PipelineCompiler workers, whoever asks for it first.
+     * The cache never destroys a pipeline itself : the ones it drops are returned so the
+     * caller can destroy them once no frame in flight uses them anymore.
+     */
+    class PipelineStateCache
+    {
+    public:
+        // Builds the description of a state, and the shader keys it is compiled from
+        using DescribeFunction = std::function<GraphicsPipelineDescription(const PipelineStateKey& state, std::vector<std::string>& shaders)>;
+
+    private:
+        struct Entry
+        {
+            std::shared_future<VkPipeline> pipeline;
+            std::vector<std::string> shaders;
+        };
+
+        PipelineCompiler& _compiler;
+        DescribeFunction _describe;
+
+        std::unordered_map<PipelineStateKey, Entry> _pipelines;
+
+    public:
+        PipelineStateCache(PipelineCompiler& compiler, DescribeFunction describe);
+
+        // Compiles the states not in the cache yet, as one batch
+        void Request(const std::vector<PipelineStateKey>& states);
+
+        // VK_NULL_HANDLE if the pipeline is still being compiled and isWaiting is false
+        VkPipeline Get(const PipelineStateKey& state, bool isWaiting);
+
+        // Waits for every pending pipeline, rethrows if one failed
+        void WaitAll();
+
+        // Compiles again the pipelines built from one of the shaders and returns the previous ones
+        std::vector<std::shared_future<VkPipeline>> Rebuild(const std::vector<std::string>& changedShaders);
+
+        // Empties the cache and returns every pipeline
+        std::vector<std::shared_future<VkPipeline>> Clear();
+
+        inline size_t GetSize() const { return _pipelines.size(); }
+    };
+}
+
+#endif// __PIPELINE_STATE_CACHE_H__
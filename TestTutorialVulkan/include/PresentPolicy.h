@@ -0,0 +1,41 @@
+#ifndef __PRESENT_POLICY_H__
+#define __PRESENT_POLICY_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "VulkanIncludes.h"
+
+namespace Vulkan
+{
+    // Trade-off between latency and throughput, chosen at startup and switchable at runtime
+    enum PresentPolicy
+    {
+        // As little queued as possible between the CPU work of a frame and its display
+        PRESENT_POLICY_LOW_LATENCY,
+        // As many frames as possible, the CPU and the GPU never wait on each other
+        PRESENT_POLICY_THROUGHPUT,
+        // Paced by the display, no tearing
+        PRESENT_POLICY_VSYNC,
+        PRESENT_POLICY_COUNT
+    };
+
+    struct PresentPolicySettings
+    {
+        // Used on the command line, i.e. low-latency
+        const char* name;
+        // In order of preference, FIFO is always supported and ends every list
+        std::vector<VkPresentModeKHR> presentModes;
+        uint32_t framesInFlight;
+    };
+
+    const PresentPolicySettings& GetPresentPolicySettings(PresentPolicy policy);
+
+    // Throws if no policy has this name
+    PresentPolicy ParsePresentPolicy(const std::string& name);
+
+    const char* GetPresentModeName(VkPresentModeKHR presentMode);
+}
+
+#endif// __PRESENT_POLICY_H__
@@ -0,0 +1,172 @@
+#ifndef __RENDER_GRAPH_H__
+#define __RENDER_GRAPH_H__
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "VulkanIncludes.h"
+
+namespace Vulkan
+{
+    // How a pass uses a resource, each one implies its stages, accesses and image layout
+    enum RenderGraphAccess
+    {
+        RENDER_GRAPH_ACCESS_TRANSFER_READ,
+        RENDER_GRAPH_ACCESS_TRANSFER_WRITE,
+        // Storage buffers, or images in the general layout
+        RENDER_GRAPH_ACCESS_COMPUTE_READ,
+        RENDER_GRAPH_ACCESS_COMPUTE_WRITE,
+        RENDER_GRAPH_ACCESS_COMPUTE_READ_WRITE,
+        // Images in the shader read only layout
+        RENDER_GRAPH_ACCESS_COMPUTE_SAMPLED_READ,
+        RENDER_GRAPH_ACCESS_INDIRECT_READ,
+        RENDER_GRAPH_ACCESS_VERTEX_READ,
+        // Cleared, or loaded then drawn on
+        RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE,
+        RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_READ_WRITE,
+        RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_WRITE,
+        RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_READ_WRITE,
+    };
+
+    // Synchronization state of a resource at the boundary of the frame
+    struct RenderGraphState
+    {
+        VkPipelineStageFlags stages;
+        VkAccessFlags        access;
+        VkImageLayout        layout;
+    };
+
+    // Image created and owned by the graph, alive for the frame only
+    struct RenderGraphImageDescription
+    {
+        VkFormat           format;
+        VkExtent2D         extent;
+        uint32_t           mipLevels;
+        VkImageUsageFlags  usage;
+        VkImageAspectFlags aspect;
+    };
+
+    /*
+     * Passes of a frame, declared with the resources they read and write
+     * Compile() culls the passes nothing reads from, places the transient images whose lifetimes
+     * do not overlap in the same memory, and plans the barriers : one batched vkCmdPipelineBarrier
+     * before a pass, only for the hazards and layout changes of its resources.
+     * The graph is compiled once and executed every frame; only the imported images are bound per frame.
+     * Buffers are synchronized with global memory barriers, a buffer resource needs no handle.
+     */
+    class RenderGraph
+    {
+    public:
+        using Resource = uint32_t;
+
+        struct Use
+        {
+            Resource resource;
+            RenderGraphAccess access;
+        };
+
+    private:
+        enum ResourceType
+        {
+            RESOURCE_TYPE_IMPORTED_IMAGE,
+            RESOURCE_TYPE_IMPORTED_BUFFER,
+            RESOURCE_TYPE_TRANSIENT_IMAGE,
+        };
+
+        struct ResourceEntry
+        {
+            std::string name;
+            ResourceType type;
+            VkImageAspectFlags aspect;
+            // Imported images : handed over in initialState, left in finalState
+            RenderGraphState initialState;
+            RenderGraphState finalState;
+            // Imported buffers : its content is kept from one frame to the next
+            bool isPersistent;
+            RenderGraphImageDescription description;
+
+            VkImage image;
+            // Transient images : index of the memory block, and passes between the first and the last use
+            uint32_t memoryBlock;
+            uint32_t firstPass;
+            uint32_t lastPass;
+            bool isUsed;
+        };
+
+        struct PassEntry
+        {
+            std::string name;
+            std::vector<Use> uses;
+            std::function<void(VkCommandBuffer)> record;
+            bool isCulled;
+        };
+
+        struct ImageBarrier
+        {
+            Resource resource;
+            VkImageLayout oldLayout;
+            VkImageLayout newLayout;
+            VkAccessFlags srcAccess;
+            VkAccessFlags dstAccess;
+        };
+
+        struct Barrier
+        {
+            VkPipelineStageFlags srcStages;
+            VkPipelineStageFlags dstStages;
+            VkAccessFlags srcAccess;
+            VkAccessFlags dstAccess;
+            std::vector<ImageBarrier> imageBarriers;
+        };
+
+        // Barriers before each pass, then the one handing the imported images back
+        struct Step
+        {
+            uint32_t pass;
+            Barrier barrier;
+        };
+
+        VkDevice _device;
+        VkPhysicalDeviceMemoryProperties _memoryProperties;
+
+        std::vector<ResourceEntry> _resources;
+        std::vector<PassEntry> _passes;
+
+        std::vector<Step> _steps;
+        Barrier _finalBarrier {};
+        std::vector<VkDeviceMemory> _memoryBlocks;
+        VkDeviceSize _transientMemorySize = 0;
+        VkDeviceSize _unaliasedMemorySize = 0;
+
+        void CullPasses();
+        void AllocateTransients();
+        void PlanBarriers();
+        void RecordBarrier(VkCommandBuffer commandBuffer, const Barrier& barrier) const;
+
+    public:
+        RenderGraph(VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties);
+
+        // The image is bound every frame with SetImage
+        Resource ImportImage(const std::string& name, VkImageAspectFlags aspect, const RenderGraphState& initialState, const RenderGraphState& finalState);
+        Resource ImportBuffer(const std::string& name, bool isPersistent);
+        Resource CreateImage(const std::string& name, const RenderGraphImageDescription& description);
+
+        // Executed in the order they are added
+        void AddPass(const std::string& name, std::vector<Use> uses, std::function<void(VkCommandBuffer)> record);
+
+        // Throws if the transient memory cannot be allocated
+        void Compile();
+        void Execute(VkCommandBuffer commandBuffer) const;
+
+        // Frees the transient images and their memory
+        void Destroy();
+
+        inline void SetImage(Resource resource, VkImage image) { _resources[resource].image = image; }
+        // VK_NULL_HANDLE for a transient image no pass uses
+        inline VkImage GetImage(Resource resource) const { return _resources[resource].image; }
+    };
+}
+
+#endif// __RENDER_GRAPH_H__
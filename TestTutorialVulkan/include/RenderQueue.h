@@ -0,0 +1,81 @@
+#ifndef __RENDER_QUEUE_H__
+#define __RENDER_QUEUE_H__
+
+#include <cstdint>
+#include <vector>
+
+#include "VulkanIncludes.h"
+
+namespace Vulkan
+{
+    // State a draw needs bound, and the indirect command it executes
+    struct RenderCommand
+    {
+        VkPipeline      pipeline;
+        // Opaque draws only : depth only for the pre-pass, then shading the fragments it left nearest.
+        // Null when the batch is not part of the pre-pass, or one of them is not compiled yet.
+        VkPipeline      depthPrePassPipeline;
+        VkPipeline      depthEqualPipeline;
+        VkDescriptorSet descriptorSet;
+        VkBuffer        vertexBuffer;
+        VkBuffer        indexBuffer;
+        // Index in the indirect command buffer
+        uint32_t        drawCommand;
+    };
+
+    /*
+     * Draws submitted with a 64-bit sort key, radix sorted once per frame
+     * From the most significant bits : pass | pipeline | material | mesh | depth
+     * Transparent draws move the depth right under the pass : pass | depth | pipeline | material | mesh
+     * Recording the commands in key order keeps the draws sharing a state next to each other,
+     * so the recorder only binds what changed.
+     */
+    class RenderQueue
+    {
+    public:
+        enum Pass : uint32_t
+        {
+            PASS_OPAQUE,
+            // Discards, after the opaque draws so they fill as much of the depth buffer as possible
+            PASS_ALPHA_TESTED,
+            // Back to front
+            PASS_TRANSPARENT,
+        };
+
+        static constexpr uint32_t PASS_BITS     { 4 };
+        static constexpr uint32_t PIPELINE_BITS { 12 };
+        static constexpr uint32_t MATERIAL_BITS { 12 };
+        static constexpr uint32_t MESH_BITS     { 12 };
+        static constexpr uint32_t DEPTH_BITS    { 24 };
+
+        static_assert(PASS_BITS + PIPELINE_BITS + MATERIAL_BITS + MESH_BITS + DEPTH_BITS == 64, "Sort key must use 64 bits");
+
+        // Ids wider than their field are truncated. Depth is normalized to [0, 1], it is clamped.
+        // Within PASS_TRANSPARENT the depth is inverted and sorts before the state, the farthest draw goes first.
+        static uint64_t MakeKey(Pass pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+        void Clear();
+        void Push(uint64_t key, const RenderCommand& command);
+        // Stable, draws with equal keys keep their submission order
+        void Sort();
+
+        // In key order once sorted
+        inline size_t GetSize() const { return _entries.size(); }
+        inline const RenderCommand& GetCommand(size_t index) const { return _commands[_entries[index].command]; }
+        inline RenderCommand& GetCommand(size_t index) { return _commands[_entries[index].command]; }
+
+    private:
+        struct Entry
+        {
+            uint64_t key;
+            uint32_t command;
+        };
+
+        std::vector<Entry> _entries;
+        // Ping-pong buffer of the radix sort
+        std::vector<Entry> _sortedEntries;
+        std::vector<RenderCommand> _commands;
+    };
+}
+
+#endif// __RENDER_QUEUE_H__
@@ -0,0 +1,88 @@
+#ifndef __SHADER_MANAGER_H__
+#define __SHADER_MANAGER_H__
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <shaderc/shaderc.hpp>
+
+#include "VulkanIncludes.h"
+
+namespace Vulkan
+{
+    struct ShaderDefine
+    {
+        std::string name;
+        std::string value;
+    };
+
+    // SPIR-V words, embedded in the executable or compiled at runtime.
+    // Holding it keeps the words alive even after a reload replaced them.
+    struct ShaderCode
+    {
+        const uint32_t* words = nullptr;
+        size_t wordCount = 0;
+        // Null for the embedded binaries
+        std::shared_ptr<const std::vector<uint32_t>> owner;
+    };
+
+    /*
+     * Shaders are embedded in the executable at build time (see EmbeddedShaders.h) and used
+     * without any file access. With the SHADER_HOT_RELOAD environment variable set, or for a variant
+     * that was not embedded, they are compiled from the GLSL sources at runtime through shaderc :
+     * SPIR-V is cached on disk, named after a hash of the preprocessed source (includes resolved,
+     * macros expanded) and the defines. A warm start only preprocesses, no compilation happens.
+     * Sources and their includes are watched so shaders can be reloaded while the application runs.
+     */
+    class ShaderManager
+    {
+        struct Shader
+        {
+            std::string path;
+            VkShaderStageFlagBits stage;
+            std::vector<ShaderDefine> defines;
+
+            std::shared_ptr<const std::vector<uint32_t>> spirv;
+
+            // The source file itself and every file it includes, with the time they were read
+            std::vector<std::pair<std::filesystem::path, std::filesystem::file_time_type>> dependencies;
+        };
+
+        class Includer;
+
+        shaderc::Compiler _compiler;
+        std::filesystem::path _cacheDirectory;
+        bool _isUsingSourceFiles;
+
+        std::unordered_map<std::string, Shader> _shaders;
+
+        bool Build(Shader& shader);
+        bool ReadCache(const std::filesystem::path& path, std::vector<uint32_t>& spirv);
+        void WriteCache(const std::filesystem::path& path, const std::vector<uint32_t>& spirv);
+
+    public:
+        explicit ShaderManager(const std::string& cacheDirectory);
+
+        // Unique name of a shader variant, also what PollChanges() reports
+        static std::string MakeKey(const std::string& path, const std::vector<ShaderDefine>& defines);
+
+        // Throws if the shader cannot be compiled
+        ShaderCode Load(
+            const std::string& path,
+            VkShaderStageFlagBits stage,
+            const std::vector<ShaderDefine>& defines = {});
+
+        // Rebuilds the shaders whose source or includes changed on disk and returns their keys.
+        // A shader that fails to compile keeps its previous SPIR-V.
+        std::vector<std::string> PollChanges();
+
+        inline bool IsUsingSourceFiles() const { return _isUsingSourceFiles; }
+    };
+}
+
+#endif// __SHADER_MANAGER_H__
@@ -0,0 +1,68 @@
+#ifndef __SHADER_REFLECTION_H__
+#define __SHADER_REFLECTION_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "VulkanIncludes.h"
+
+namespace Vulkan
+{
+    struct ShaderBinding
+    {
+        // Instance name of a block (i.e. iUBO), variable name otherwise
+        std::string name;
+        uint32_t set;
+        VkDescriptorSetLayoutBinding layoutBinding;
+    };
+
+    struct ShaderVertexInput
+    {
+        std::string name;
+        uint32_t location;
+        VkFormat format;
+    };
+
+    /*
+     * Interface of a shader, read from its SPIR-V
+     * Descriptor bindings, push constant ranges and, for vertex shaders, the vertex inputs.
+     * Reflections of several stages or several pipelines are merged into one, which gives
+     * the layouts they can share and the size of a pool serving all of them.
+     */
+    class ShaderReflection
+    {
+        std::vector<ShaderBinding> _bindings;
+        std::vector<VkPushConstantRange> _pushConstantRanges;
+        std::vector<ShaderVertexInput> _vertexInputs;
+
+    public:
+        // Throws if the binary is not valid SPIR-V or uses an unsupported resource
+        static ShaderReflection Reflect(const uint32_t* words, size_t wordCount, VkShaderStageFlagBits stage);
+
+        // Union of both interfaces, throws if a binding is declared with two different types
+        void Merge(const ShaderReflection& other);
+
+        // Number of descriptor sets, including the unused ones below the highest
+        uint32_t GetSetCount() const;
+        std::vector<VkDescriptorSetLayoutBinding> GetSetBindings(uint32_t set) const;
+
+        // Throws if no binding has this name
+        const ShaderBinding& FindBinding(const std::string& name) const;
+
+        // Pool sizes to allocate setCopies times every descriptor set
+        std::vector<VkDescriptorPoolSize> GetPoolSizes(uint32_t setCopies) const;
+        // Same, for one descriptor set only
+        std::vector<VkDescriptorPoolSize> GetPoolSizes(uint32_t setCopies, uint32_t set) const;
+
+        // Stages of the push constant ranges, what vkCmdPushConstants expects
+        VkShaderStageFlags GetPushConstantStages() const;
+
+        inline const std::vector<ShaderBinding>& GetBindings() const { return _bindings; }
+        inline const std::vector<VkPushConstantRange>& GetPushConstantRanges() const { return _pushConstantRanges; }
+        inline const std::vector<ShaderVertexInput>& GetVertexInputs() const { return _vertexInputs; }
+    };
+}
+
+#endif// __SHADER_REFLECTION_H__
@@ -0,0 +1,103 @@
+#ifndef __SHADER_VARIANT_H__
+#define __SHADER_VARIANT_H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "VulkanIncludes.h"
+#include "ShaderManager.h"
+
+namespace Vulkan
+{
+    /*
+     * Features a shader permutation can toggle
+     * Most are specialization constants : one SPIR-V binary, the driver removes the dead paths
+     * when the pipeline is created. The ones listed in DEFINE_FEATURES change the shader interface
+     * or how the driver treats the whole shader (i.e. discard disables early depth tests on some GPUs),
+     * those are compiled as separate binaries through #define.
+     */
+    enum ShaderFeature : uint32_t
+    {
+        SHADER_FEATURE_TEXTURED     = 1 << 0,
+        SHADER_FEATURE_VERTEX_COLOR = 1 << 1,
+        SHADER_FEATURE_ALPHA_TEST   = 1 << 2,
+        // Position only vertex shader (depth.vert) and no fragment shader, the other features do not apply
+        SHADER_FEATURE_DEPTH_ONLY   = 1 << 3,
+    };
+
+    struct ShaderVariantKey
+    {
+        static constexpr uint32_t DEFINE_FEATURES { SHADER_FEATURE_ALPHA_TEST };
+
+        uint32_t features = SHADER_FEATURE_TEXTURED | SHADER_FEATURE_VERTEX_COLOR;
+        float    alphaCutoff = 0.5f;
+
+        bool operator==(const ShaderVariantKey& other) const
+        {
+            return features == other.features && alphaCutoff == other.alphaCutoff;
+        }
+
+        bool HasFeature(ShaderFeature feature) const
+        {
+            return (features & feature) != 0;
+        }
+
+        // Defines for the features compiled into separate binaries
+        std::vector<ShaderDefine> GetDefines() const
+        {
+            std::vector<ShaderDefine> defines;
+            if (HasFeature(SHADER_FEATURE_ALPHA_TEST)) defines.push_back({ "ALPHA_TEST", "1" });
+            return defines;
+        }
+    };
+
+    // Values of the specialization constants, the layout follows the constant_id in the shaders
+    struct ShaderSpecialization
+    {
+        VkBool32 isTextured;     // constant_id = 0
+        VkBool32 useVertexColor; // constant_id = 1
+        float    alphaCutoff;    // constant_id = 2
+
+        explicit ShaderSpecialization(const ShaderVariantKey& key)
+            : isTextured     { static_cast<VkBool32>(key.HasFeature(SHADER_FEATURE_TEXTURED)) }
+            , useVertexColor { static_cast<VkBool32>(key.HasFeature(SHADER_FEATURE_VERTEX_COLOR)) }
+            , alphaCutoff    { key.alphaCutoff }
+        {
+        }
+
+        static std::array<VkSpecializationMapEntry, 3> GetMapEntries()
+        {
+            std::array<VkSpecializationMapEntry, 3> mapEntries {};
+
+            mapEntries[0].constantID = 0;
+            mapEntries[0].offset = offsetof(ShaderSpecialization, isTextured);
+            mapEntries[0].size = sizeof(VkBool32);
+
+            mapEntries[1].constantID = 1;
+            mapEntries[1].offset = offsetof(ShaderSpecialization, useVertexColor);
+            mapEntries[1].size = sizeof(VkBool32);
+
+            mapEntries[2].constantID = 2;
+            mapEntries[2].offset = offsetof(ShaderSpecialization, alphaCutoff);
+            mapEntries[2].size = sizeof(float);
+
+            return mapEntries;
+        }
+    };
+}
+
+namespace std
+{
+    template<> struct hash<Vulkan::ShaderVariantKey>
+    {
+        size_t operator()(Vulkan::ShaderVariantKey const& key) const
+        {
+            return (hash<uint32_t>()(key.features) << 1) ^ hash<float>()(key.alphaCutoff);
+        }
+    };
+}
+
+#endif// __SHADER_VARIANT_H__
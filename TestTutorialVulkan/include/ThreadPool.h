@@ -0,0 +1,58 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Vulkan
+{
+    // Fixed set of worker threads consuming a FIFO of tasks
+    class ThreadPool
+    {
+        std::vector<std::thread> _workers;
+        std::queue<std::function<void()>> _tasks;
+
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        bool _isStopping = false;
+
+        void WorkerLoop();
+
+    public:
+        // 0 : one worker per hardware thread, minus the one running the application
+        explicit ThreadPool(size_t workerCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        template<typename Task>
+        auto Submit(Task&& task) -> std::future<std::invoke_result_t<std::decay_t<Task>>>
+        {
+            using Result = std::invoke_result_t<std::decay_t<Task>>;
+
+            // std::function needs a copyable target, the packaged_task is shared
+            auto packagedTask { std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task)) };
+            std::future<Result> future { packagedTask->get_future() };
+
+            {
+                std::lock_guard<std::mutex> lock { _mutex };
+                _tasks.emplace([packagedTask]() { (*packagedTask)(); });
+            }
+            _condition.notify_one();
+
+            return future;
+        }
+
+        inline size_t GetWorkerCount() const { return _workers.size(); }
+    };
+}
+
+#endif// __THREAD_POOL_H__
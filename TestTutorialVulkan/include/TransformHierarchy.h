@@ -0,0 +1,62 @@
+#ifndef __TRANSFORM_HIERARCHY_H__
+#define __TRANSFORM_HIERARCHY_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace Vulkan
+{
+    // Translation, rotation and scale relative to the parent
+    struct LocalTransform
+    {
+        glm::vec3 position { 0.0f };
+        glm::quat rotation { 1.0f, 0.0f, 0.0f, 0.0f };
+        glm::vec3 scale    { 1.0f };
+    };
+
+    /*
+     * Scene transforms as structure of arrays, indexed by node
+     * A parent is always added before its children, so the nodes are sorted topologically:
+     * one linear pass updates the world matrices, each parent before the nodes below it.
+     * Only the nodes changed since the last update, and their subtrees, are recomputed.
+     */
+    class TransformHierarchy
+    {
+        std::vector<uint32_t>  _parents;
+        std::vector<glm::vec3> _positions;
+        std::vector<glm::quat> _rotations;
+        std::vector<glm::vec3> _scales;
+        std::vector<glm::mat4> _worldMatrices;
+        // uint8_t rather than bool, std::vector<bool> packs bits
+        std::vector<uint8_t>   _isDirty;
+        // First dirty node, the update starts there
+        size_t _firstDirty = 0;
+
+        void MarkDirty(uint32_t node);
+
+    public:
+        static constexpr uint32_t NO_PARENT { UINT32_MAX };
+
+        // Throws if the parent does not exist yet
+        uint32_t Add(uint32_t parent, const LocalTransform& local = {});
+
+        void SetLocal(uint32_t node, const LocalTransform& local);
+        void SetPosition(uint32_t node, const glm::vec3& position);
+        void SetRotation(uint32_t node, const glm::quat& rotation);
+        void SetScale(uint32_t node, const glm::vec3& scale);
+
+        // Recomputes the world matrices of the dirty nodes and of everything below them
+        void Update();
+
+        // As of the last Update
+        inline const glm::mat4& GetWorldMatrix(uint32_t node) const { return _worldMatrices[node]; }
+        inline uint32_t GetParent(uint32_t node) const { return _parents[node]; }
+        inline size_t GetSize() const { return _parents.size(); }
+    };
+}
+
+#endif// __TRANSFORM_HIERARCHY_H__
@@ -0,0 +1,59 @@
+#ifndef __TRIPLE_BUFFER_H__
+#define __TRIPLE_BUFFER_H__
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace Vulkan
+{
+    /*
+     * Lock-free handoff of the latest value from one writer thread to one reader thread
+     * Each side owns one of the three buffers and the third is shared : publishing and acquiring
+     * swap the owned buffer with the shared one, so neither side ever waits on the other.
+     * A value published again before being acquired replaces the previous one.
+     */
+    template<typename T>
+    class TripleBuffer
+    {
+        static constexpr uint32_t INDEX_MASK { 0x3 };
+        // Set along with the shared index by Publish, cleared by Acquire
+        static constexpr uint32_t FRESH_BIT  { 0x4 };
+
+        std::array<T, 3> _buffers {};
+        std::atomic<uint32_t> _shared { 0 };
+        // Only accessed by their own side
+        uint32_t _writeIndex = 1;
+        uint32_t _readIndex  = 2;
+
+    public:
+        // ==== Writer ==== //
+        // Keeps its content from the last time it was written, the allocations can be reused
+        inline T& GetWriteBuffer() { return _buffers[_writeIndex]; }
+
+        void Publish()
+        {
+            // Release : the reader acquiring the buffer sees everything written to it
+            _writeIndex = _shared.exchange(_writeIndex | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+        }
+
+        // The last published value has not been acquired yet
+        inline bool IsFresh() const { return (_shared.load(std::memory_order_acquire) & FRESH_BIT) != 0; }
+
+        // ==== Reader ==== //
+        // False if nothing was published since the last acquire, the read buffer is left as is
+        bool Acquire()
+        {
+            if (!IsFresh())
+                return false;
+
+            // The writer may have published again in between, the exchange takes the latest
+            _readIndex = _shared.exchange(_readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+            return true;
+        }
+
+        inline const T& GetReadBuffer() const { return _buffers[_readIndex]; }
+    };
+}
+
+#endif// __TRIPLE_BUFFER_H__
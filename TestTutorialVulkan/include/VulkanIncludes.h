@@ -1,4 +1,63 @@
 #pragma once
 
 #define GLFW_INCLUDE_VULKAN
-#include <GLFW/glfw3.h>
\ No newline at end of file
+#include <GLFW/glfw3.h>
+
+// The bundled headers (1.1.108) predate VK_KHR_timeline_semaphore, its declarations are copied from the registry
+#ifndef VK_KHR_timeline_semaphore
+#define VK_KHR_timeline_semaphore 1
+#define VK_KHR_TIMELINE_SEMAPHORE_SPEC_VERSION 2
+#define VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME "VK_KHR_timeline_semaphore"
+
+inline constexpr VkStructureType VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR { static_cast<VkStructureType>(1000207000) };
+inline constexpr VkStructureType VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR { static_cast<VkStructureType>(1000207002) };
+inline constexpr VkStructureType VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR { static_cast<VkStructureType>(1000207003) };
+inline constexpr VkStructureType VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR { static_cast<VkStructureType>(1000207004) };
+
+typedef enum VkSemaphoreTypeKHR
+{
+    VK_SEMAPHORE_TYPE_BINARY_KHR = 0,
+    VK_SEMAPHORE_TYPE_TIMELINE_KHR = 1,
+    VK_SEMAPHORE_TYPE_MAX_ENUM_KHR = 0x7FFFFFFF
+} VkSemaphoreTypeKHR;
+
+typedef VkFlags VkSemaphoreWaitFlagsKHR;
+
+typedef struct VkPhysicalDeviceTimelineSemaphoreFeaturesKHR
+{
+    VkStructureType sType;
+    void*           pNext;
+    VkBool32        timelineSemaphore;
+} VkPhysicalDeviceTimelineSemaphoreFeaturesKHR;
+
+typedef struct VkSemaphoreTypeCreateInfoKHR
+{
+    VkStructureType    sType;
+    const void*        pNext;
+    VkSemaphoreTypeKHR semaphoreType;
+    uint64_t           initialValue;
+} VkSemaphoreTypeCreateInfoKHR;
+
+typedef struct VkTimelineSemaphoreSubmitInfoKHR
+{
+    VkStructureType sType;
+    const void*     pNext;
+    uint32_t        waitSemaphoreValueCount;
+    const uint64_t* pWaitSemaphoreValues;
+    uint32_t        signalSemaphoreValueCount;
+    const uint64_t* pSignalSemaphoreValues;
+} VkTimelineSemaphoreSubmitInfoKHR;
+
+typedef struct VkSemaphoreWaitInfoKHR
+{
+    VkStructureType         sType;
+    const void*             pNext;
+    VkSemaphoreWaitFlagsKHR flags;
+    uint32_t                semaphoreCount;
+    const VkSemaphore*      pSemaphores;
+    const uint64_t*         pValues;
+} VkSemaphoreWaitInfoKHR;
+
+typedef VkResult (VKAPI_PTR *PFN_vkGetSemaphoreCounterValueKHR)(VkDevice device, VkSemaphore semaphore, uint64_t* pValue);
+typedef VkResult (VKAPI_PTR *PFN_vkWaitSemaphoresKHR)(VkDevice device, const VkSemaphoreWaitInfoKHR* pWaitInfo, uint64_t timeout);
+#endif
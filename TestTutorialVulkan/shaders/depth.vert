@@ -0,0 +1,34 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "instance.glsl"
+
+// Position only, for the depth pre-pass : same bindings as shader.vert, no fragment shader
+layout (binding = 0) uniform UniformBufferObject
+{
+    mat4 view;
+    mat4 projection;
+} iUBO;
+
+layout (binding = 2) readonly buffer Instances
+{
+    Instance instances[];
+} iInstances;
+
+layout (binding = 3) readonly buffer VisibleInstances
+{
+    uint indices[];
+} iVisibleInstances;
+
+layout (location = 0) in vec3 iPosition;
+
+// The main pass tests against this depth with VK_COMPARE_OP_EQUAL, both shaders must compute it identically
+invariant gl_Position;
+
+void main()
+{
+    Instance instance = iInstances.instances[iVisibleInstances.indices[gl_InstanceIndex]];
+
+    gl_Position = iUBO.projection * iUBO.view * instance.model * vec4(iPosition, 1.0);
+}
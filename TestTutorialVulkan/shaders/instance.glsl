@@ -0,0 +1,9 @@
+// Per-instance data, see InstanceData
+struct Instance
+{
+    mat4 model;
+    // Local space center, radius
+    vec4 boundingSphere;
+    uint objectId;
+    uint batch;
+};
@@ -1,6 +1,11 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// Permutation switches, see ShaderSpecialization
+layout (constant_id = 0) const bool USE_TEXTURE = true;
+layout (constant_id = 1) const bool USE_VERTEX_COLOR = true;
+layout (constant_id = 2) const float ALPHA_CUTOFF = 0.5;
+
 layout (location = 0) in vec3 vFragColor;
 layout (location = 1) in vec2 vUV;
 
@@ -10,5 +15,18 @@ layout (binding = 1) uniform sampler2D uTexture;
 
 void main()
 {
-    oColor = texture(uTexture, vUV) * vec4(vFragColor, 1.0);
+    vec4 color = vec4(1.0);
+
+    if (USE_TEXTURE)
+        color *= texture(uTexture, vUV);
+
+    if (USE_VERTEX_COLOR)
+        color.rgb *= vFragColor;
+
+#ifdef ALPHA_TEST
+    if (color.a < ALPHA_CUTOFF)
+        discard;
+#endif
+
+    oColor = color;
 }
\ No newline at end of file
@@ -1,13 +1,27 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "instance.glsl"
 
 layout (binding = 0) uniform UniformBufferObject
 {
-    mat4 model;
     mat4 view;
     mat4 projection;
 } iUBO;
 
+// Written by the CPU
+layout (binding = 2) readonly buffer Instances
+{
+    Instance instances[];
+} iInstances;
+
+// Written by the culling pass, gl_InstanceIndex starts at the firstInstance of the batch
+layout (binding = 3) readonly buffer VisibleInstances
+{
+    uint indices[];
+} iVisibleInstances;
+
 layout (location = 0) in vec3 iPosition;
 layout (location = 1) in vec3 iColor;
 layout (location = 2) in vec2 iUV;
@@ -15,9 +29,14 @@ layout (location = 2) in vec2 iUV;
 layout (location = 0) out vec3 vFragColor;
 layout (location = 1) out vec2 vUV;
 
+// Same depth as depth.vert, see the depth pre-pass
+invariant gl_Position;
+
 void main() 
 {
-    gl_Position = iUBO.projection * iUBO.view * iUBO.model * vec4(iPosition, 1.0);
+    Instance instance = iInstances.instances[iVisibleInstances.indices[gl_InstanceIndex]];
+
+    gl_Position = iUBO.projection * iUBO.view * instance.model * vec4(iPosition, 1.0);
 
     vFragColor = iColor;
     vUV = iUV;
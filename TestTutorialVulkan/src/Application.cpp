@@ -8,21 +8,36 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
+#include "ObjStreamReader.h"
 
 #include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <limits>
 #include <algorithm>
 #include <map>
 #include <unordered_map>
 #include <set>
 #include <iostream>
 #include <fstream>
+#include <iomanip>
+#include <filesystem>
 #include <stdexcept>
 
 namespace Vulkan
 {
+    Application::Application(PresentPolicy presentPolicy)
+        : _presentPolicy { presentPolicy }
+        , _requestedPresentPolicy { presentPolicy }
+        , _framesInFlight { GetPresentPolicySettings(presentPolicy).framesInFlight }
+    {
+    }
+
+    Application::~Application()
+    {
+        StopSimulation();
+    }
+
     void Application::Run()
     {
         InitWindow();
@@ -41,6 +56,7 @@ namespace Vulkan
         _window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
         glfwSetWindowUserPointer(_window, this);
         glfwSetFramebufferSizeCallback(_window, Application::FrameBufferResizeCallback);
+        glfwSetKeyCallback(_window, Application::KeyCallback);
     }
 
     void Application::InitVulkan()
@@ -52,16 +68,28 @@ namespace Vulkan
         
         PickPhysicalDevice();
         CreateLogicalDevice();
+        CreatePipelineCache();
+        _pipelineCompiler = std::make_unique<PipelineCompiler>(_device, _pipelineCache, _threadPool);
+        _layoutCache = std::make_unique<LayoutCache>(_device);
         
         CreateSwapChain();
         CreateImageViews();
         CreateRenderPass();
+        ReflectShaders();
         CreateDescriptorSetLayout();
-        CreateGraphicsPipeline();
+        CreatePipelineLayout();
+        CreateGraphicsPipelines();
+        CreateCullPipelineLayout();
+        CreateCullPipeline();
+        CreateDepthReducePipelineLayout();
+        CreateDepthReducePipeline();
 
         CreateCommandPool();
 
+        CreateRenderGraph();
         CreateDepthResources();
+        CreateDepthPyramidSampler();
+        CreateDepthPyramid();
         CreateFramebuffers();
 
         CreateTextureImage();
@@ -69,14 +97,16 @@ namespace Vulkan
         CreateTextureSampler();
 
         LoadModel();
-        CreateVertexBuffer();
-        CreateIndexBuffer();
+        CreateScene();
         CreateUniformBuffer();
+        CreateInstanceBuffers();
+        CreateVisibilityBuffer();
 
         CreateDescriptorPool();
         CreateDescriptorSets();
 
         CreateCommandBuffers();
+        CreateQueryPools();
 
         CreateSyncObjects();
     }
@@ -94,7 +124,8 @@ namespace Vulkan
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "No Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        // VK_KHR_timeline_semaphore needs 1.1, for vkGetPhysicalDeviceFeatures2 among others
+        appInfo.apiVersion = VK_API_VERSION_1_1;
 
         VkInstanceCreateInfo createInfo {};
         createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -306,10 +337,32 @@ namespace Vulkan
             swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
         }
 
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+
+        // Listing the extension does not mean the feature is supported, it is queried once the extension is known to be there
+        bool timelineSemaphoreSupported = false;
+        if (extensionsSupported && properties.apiVersion >= VK_API_VERSION_1_1)
+        {
+            VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures {};
+            timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+
+            VkPhysicalDeviceFeatures2 features {};
+            features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features.pNext = &timelineSemaphoreFeatures;
+            vkGetPhysicalDeviceFeatures2(device, &features);
+
+            timelineSemaphoreSupported = timelineSemaphoreFeatures.timelineSemaphore == VK_TRUE;
+        }
+
         VkPhysicalDeviceFeatures supportedFeatures;
         vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
-        return indices.IsComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
+        // Batches sharing a pipeline are drawn by one vkCmdDrawIndexedIndirect, firstInstance indexes the visible instances
+        bool indirectDrawsSupported { supportedFeatures.multiDrawIndirect && supportedFeatures.drawIndirectFirstInstance };
+
+        return indices.IsComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy && indirectDrawsSupported
+            && timelineSemaphoreSupported;
     }
 
     bool Application::CheckDeviceExtensionSupport(VkPhysicalDevice device)
@@ -416,8 +469,16 @@ namespace Vulkan
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(_physicalDevice, &supportedFeatures);
+        _hasPipelineStatistics = supportedFeatures.pipelineStatisticsQuery == VK_TRUE;
+
         VkPhysicalDeviceFeatures deviceFeatures {};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
+        // Optional, only used to measure the overdraw
+        deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+        deviceFeatures.multiDrawIndirect = VK_TRUE;
+        deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
 
         VkDeviceCreateInfo createInfo {};
         createInfo.sType                = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -426,13 +487,19 @@ namespace Vulkan
 
         createInfo.pEnabledFeatures = &deviceFeatures;
 
+        // Checked by IsDeviceSuitable
+        VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures {};
+        timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+        timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+        createInfo.pNext = &timelineSemaphoreFeatures;
+
         // Enable device extensions
         createInfo.enabledExtensionCount = static_cast<uint32_t>(_deviceExtensions.size());
         createInfo.ppEnabledExtensionNames = _deviceExtensions.data();
 
         if (_enableValidationLayers)
         {
-            createInfo.enabledExtensionCount = static_cast<uint32_t>(_validationLayers.size());
+            createInfo.enabledLayerCount     = static_cast<uint32_t>(_validationLayers.size());
             createInfo.ppEnabledLayerNames   = _validationLayers.data();
         }
         else
@@ -447,6 +514,104 @@ namespace Vulkan
 
         vkGetDeviceQueue(_device, indices.graphicsFamily.value(), 0, &_graphicsQueue);
         vkGetDeviceQueue(_device, indices.presentFamily.value(),  0, &_presentQueue);
+
+        // Extension commands are not exported by the loader
+        _vkWaitSemaphores = (PFN_vkWaitSemaphoresKHR) vkGetDeviceProcAddr(_device, "vkWaitSemaphoresKHR");
+        _vkGetSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR) vkGetDeviceProcAddr(_device, "vkGetSemaphoreCounterValueKHR");
+        if (_vkWaitSemaphores == nullptr || _vkGetSemaphoreCounterValue == nullptr)
+        {
+            throw std::runtime_error("Failed to load the timeline semaphore commands!");
+        }
+    }
+
+    void Application::CreatePipelineCache()
+    {
+        std::vector<char> initialData;
+
+        // A missing or foreign cache file is not an error, we just start cold
+        std::ifstream file { PIPELINE_CACHE_PATH, std::ios::ate | std::ios::binary };
+        if (file.is_open())
+        {
+            initialData.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(initialData.data(), initialData.size());
+
+            if (!IsPipelineCacheCompatible(initialData))
+            {
+                std::cout << "Pipeline cache: ignoring " << PIPELINE_CACHE_PATH << " (built by another device or driver)" << std::endl;
+                initialData.clear();
+            }
+        }
+
+        VkPipelineCacheCreateInfo createInfo {};
+        createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        createInfo.initialDataSize = initialData.size();
+        createInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+        if (vkCreatePipelineCache(_device, &createInfo, nullptr, &_pipelineCache) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create pipeline cache!");
+        }
+
+        _isPipelineCacheSeeded = !initialData.empty();
+    }
+
+    bool Application::IsPipelineCacheCompatible(const std::vector<char>& data)
+    {
+        /*
+         * Pipeline cache header (VK_PIPELINE_CACHE_HEADER_VERSION_ONE) :
+         * uint32_t headerSize
+         * uint32_t headerVersion
+         * uint32_t vendorID
+         * uint32_t deviceID
+         * uint8_t  pipelineCacheUUID[VK_UUID_SIZE]
+         */
+        constexpr size_t HEADER_SIZE { 4 * sizeof(uint32_t) + VK_UUID_SIZE };
+        if (data.size() < HEADER_SIZE)
+            return false;
+
+        uint32_t header[4];
+        memcpy(header, data.data(), sizeof(header));
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(_physicalDevice, &properties);
+
+        return header[0] >= HEADER_SIZE
+            && header[0] <= data.size()
+            && header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+            && header[2] == properties.vendorID
+            && header[3] == properties.deviceID
+            && memcmp(data.data() + sizeof(header), properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+
+    void Application::SavePipelineCache()
+    {
+        size_t dataSize { 0 };
+        if (vkGetPipelineCacheData(_device, _pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+            return;
+
+        std::vector<char> data(dataSize);
+        if (vkGetPipelineCacheData(_device, _pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+            return;
+
+        // Write next to the real file then swap, so a crash never leaves a truncated cache behind
+        const std::string tempPath { PIPELINE_CACHE_PATH + ".tmp" };
+        {
+            std::ofstream file { tempPath, std::ios::binary | std::ios::trunc };
+            if (!file.is_open() || !file.write(data.data(), dataSize))
+            {
+                std::cerr << "Pipeline cache: failed to write " << tempPath << std::endl;
+                return;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, PIPELINE_CACHE_PATH, error);
+        if (error)
+        {
+            std::cerr << "Pipeline cache: failed to save " << PIPELINE_CACHE_PATH << ": " << error.message() << std::endl;
+            std::filesystem::remove(tempPath, error);
+        }
     }
 
     void Application::CreateSwapChain()
@@ -457,13 +622,7 @@ namespace Vulkan
         VkPresentModeKHR    presentMode { ChooseSwapPresentMode(swapChainSupport.presentModes) };
         VkExtent2D          extent { ChooseSwapExtent(swapChainSupport.capabilities) };
 
-        // Get the minimum image count for the swap chain to work
-        uint32_t imageCount { swapChainSupport.capabilities.minImageCount + 1 };
-        if (swapChainSupport.capabilities.maxImageCount > 0
-            && imageCount > swapChainSupport.capabilities.maxImageCount)
-        {
-            imageCount = swapChainSupport.capabilities.maxImageCount;
-        }
+        uint32_t imageCount { ChooseSwapImageCount(swapChainSupport.capabilities, presentMode) };
 
         VkSwapchainCreateInfoKHR createInfo {};
         createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -474,14 +633,20 @@ namespace Vulkan
         createInfo.imageColorSpace = surfaceFormat.colorSpace;
         createInfo.imageExtent = extent;
         createInfo.imageArrayLayers = 1;
-        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        // The scene is rendered offscreen, then blitted to the image
+        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        if ((swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) == 0)
+        {
+            throw std::runtime_error("Swap chain images cannot be transfer destinations!");
+        }
 
         createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
         createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 
         createInfo.presentMode = presentMode;
         createInfo.clipped = VK_TRUE;
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
+        // Let the presentation engine hand the images over from the previous swap chain (if any)
+        createInfo.oldSwapchain = _swapChain;
 
         QueueFamilyIndices indices = FindQueueFamilies(_physicalDevice);
         uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
@@ -510,6 +675,7 @@ namespace Vulkan
 
         _swapChainImageFormat = surfaceFormat.format;
         _swapChainExtent = extent;
+        _swapChainPresentMode = presentMode;
     }
 
     SwapChainSupportDetails Application::QuerySwapChainSupport(VkPhysicalDevice device)
@@ -559,16 +725,34 @@ namespace Vulkan
 
     VkPresentModeKHR Application::ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
     {
-        for (const VkPresentModeKHR& availablePresentMode : availablePresentModes)
+        for (VkPresentModeKHR presentMode : GetPresentPolicySettings(_presentPolicy).presentModes)
         {
-            if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) 
+            if (std::find(availablePresentModes.begin(), availablePresentModes.end(), presentMode) != availablePresentModes.end())
             {
-                return availablePresentMode;
+                return presentMode;
             }
         }
         return VK_PRESENT_MODE_FIFO_KHR;
     }
 
+    uint32_t Application::ChooseSwapImageCount(const VkSurfaceCapabilitiesKHR& capabilities, VkPresentModeKHR presentMode)
+    {
+        // One image per frame in flight plus the one on screen,
+        // and with MAILBOX the one waiting to replace it
+        uint32_t imageCount { _framesInFlight + 1 };
+        if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+        {
+            ++imageCount;
+        }
+
+        imageCount = std::max(imageCount, capabilities.minImageCount);
+        if (capabilities.maxImageCount > 0 && imageCount > capabilities.maxImageCount)
+        {
+            imageCount = capabilities.maxImageCount;
+        }
+        return imageCount;
+    }
+
     VkExtent2D Application::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities)
     {
         if (capabilities.currentExtent.width != UINT32_MAX)
@@ -624,17 +808,19 @@ namespace Vulkan
         // Stencil buffer operations
         colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        // The render graph transitions the attachments between the passes, see CreateRenderGraph
+        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
         VkAttachmentDescription depthAttachment {};
         depthAttachment.format = FindDepthFormat();
         depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
         depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        // Stored for the depth pyramid, and for the late pass
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
         depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
         depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
         VkAttachmentReference colorAttachmentRef {};
@@ -651,14 +837,6 @@ namespace Vulkan
         subpass.pColorAttachments = &colorAttachmentRef;
         subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
-        VkSubpassDependency dependency {};
-        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependency.dstSubpass = 0;
-        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.srcAccessMask = 0;
-        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
         std::array<VkAttachmentDescription, 2> attachments { colorAttachment, depthAttachment };
         VkRenderPassCreateInfo renderPassInfo {};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -666,374 +844,824 @@ namespace Vulkan
         renderPassInfo.pAttachments = attachments.data();
         renderPassInfo.subpassCount = 1;
         renderPassInfo.pSubpasses = &subpass;
-        renderPassInfo.dependencyCount = 1;
-        renderPassInfo.pDependencies = &dependency;
+        // No subpass dependency, the barriers before the passes are planned by the render graph
+        renderPassInfo.dependencyCount = 0;
+        renderPassInfo.pDependencies = nullptr;
 
         if (vkCreateRenderPass(_device, &renderPassInfo, nullptr, &_renderPass) != VK_SUCCESS)
         {
             throw std::runtime_error("Failed to create render pass!");
         }
-    }
-
-    void Application::CreateDescriptorSetLayout()
-    {
-        VkDescriptorSetLayoutBinding uboLayoutBinding {};
-        uboLayoutBinding.binding = 0;
-        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        uboLayoutBinding.descriptorCount = 1;
-        /*
-         * ==== enum VK_SHADER_STAGE_ALL_GRAPHICS:: ====
-         * Uniform buffer type : self-explanatory
-         * VK_SHADER_STAGE_VERTEX_BIT
-         * VK_SHADER_STAGE_FRAGMENT_BIT
-         * VK_SHADER_STAGE_ALL_GRAPHICS
-         * ...
-         */
-        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-        // pImmutableSamplers : used for image sampling
-        uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
-
-        VkDescriptorSetLayoutBinding samplerLayoutBinding {};
-        samplerLayoutBinding.binding = 1;
-        samplerLayoutBinding.descriptorCount = 1;
-        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-        samplerLayoutBinding.pImmutableSamplers = nullptr;
 
-        std::array<VkDescriptorSetLayoutBinding, 2> bindings { uboLayoutBinding, samplerLayoutBinding };
-        VkDescriptorSetLayoutCreateInfo layoutInfo {};
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-        layoutInfo.pBindings = bindings.data();
+        // Same attachments and subpass, so compatible with the pipelines and the framebuffers.
+        // The graph hands the color attachment over to the presentation after it.
+        attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
-        if (vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_descriptorSetLayout) != VK_SUCCESS) 
+        if (vkCreateRenderPass(_device, &renderPassInfo, nullptr, &_loadRenderPass) != VK_SUCCESS)
         {
-            throw std::runtime_error("failed to create descriptor set layout!");
+            throw std::runtime_error("Failed to create render pass!");
         }
     }
 
-    void Application::CreateGraphicsPipeline()
+    void Application::CreateRenderGraph()
     {
-        // ==== Shader Reading ==== //
-        std::vector<char> vertShaderCode = ReadFile("shaders/vert.spv");
-        std::vector<char> fragShaderCode = ReadFile("shaders/frag.spv");
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &memoryProperties);
 
-        VkShaderModule vertShaderModule = CreateShaderModule(vertShaderCode);
-        VkShaderModule fragShaderModule = CreateShaderModule(fragShaderCode);
+        _renderGraph = std::make_unique<RenderGraph>(_device, memoryProperties);
+        FrameGraphResources& resources { _graphResources };
 
-        VkPipelineShaderStageCreateInfo vertShaderStageInfo {};
-        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vertShaderStageInfo.module = vertShaderModule;
-        vertShaderStageInfo.pName = "main";
+        // Acquired before the upscale writes it, the submission waits on it at the transfer stage
+        resources.swapChainImage = _renderGraph->ImportImage("SwapChainImage", VK_IMAGE_ASPECT_COLOR_BIT,
+            { VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED },
+            { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR });
+        _upscaleFilter = ChooseUpscaleFilter(_swapChainImageFormat);
 
-        VkPipelineShaderStageCreateInfo fragShaderStageInfo {};
-        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        fragShaderStageInfo.module = fragShaderModule;
-        fragShaderStageInfo.pName = "main";
+        std::array<const char*, CULL_PASS_COUNT> passNames { "Early", "Late" };
+        for (uint32_t pass = 0; pass < CULL_PASS_COUNT; ++pass)
+        {
+            resources.drawCommands[pass] = _renderGraph->ImportBuffer(std::string(passNames[pass]) + "DrawCommands", false);
+            resources.visibleInstances[pass] = _renderGraph->ImportBuffer(std::string(passNames[pass]) + "VisibleInstances", false);
+        }
+        resources.visibility = _renderGraph->ImportBuffer("Visibility", true);
 
-        VkPipelineShaderStageCreateInfo shaderStages[] { vertShaderStageInfo, fragShaderStageInfo };
+        VkFormat depthFormat { FindDepthFormat() };
+        RenderGraphImageDescription depthDescription {};
+        depthDescription.format = depthFormat;
+        depthDescription.extent = _swapChainExtent;
+        depthDescription.mipLevels = 1;
+        // Sampled by the reduction into the depth pyramid
+        depthDescription.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        depthDescription.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+        if (HasStencilComponent(depthFormat))
+            depthDescription.aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+        resources.depth = _renderGraph->CreateImage("Depth", depthDescription);
+
+        // Same format as the swap chain, the render passes and the pipelines are shared.
+        // Sized for the full resolution, only the top left part of it is rendered when scaled down.
+        RenderGraphImageDescription sceneColorDescription {};
+        sceneColorDescription.format = _swapChainImageFormat;
+        sceneColorDescription.extent = _swapChainExtent;
+        sceneColorDescription.mipLevels = 1;
+        sceneColorDescription.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        sceneColorDescription.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+        resources.sceneColor = _renderGraph->CreateImage("SceneColor", sceneColorDescription);
+
+        resources.depthPyramid = _renderGraph->CreateImage("DepthPyramid", DescribeDepthPyramid());
+
+        // The passes record with the frame and the image set in RecordCommandBuffer
+        _renderGraph->AddPass("ResetDrawCommands",
+            {
+                { resources.drawCommands[CULL_PASS_EARLY], RENDER_GRAPH_ACCESS_TRANSFER_WRITE },
+                { resources.drawCommands[CULL_PASS_LATE], RENDER_GRAPH_ACCESS_TRANSFER_WRITE },
+            },
+            [this](VkCommandBuffer commandBuffer) { RecordCommandReset(commandBuffer, *_recordingFrame); });
+
+        // The objects visible last frame are drawn first, they are the occluders of this frame.
+        // The pyramid is bound but not sampled by the early pass, its descriptor expects the general layout.
+        _renderGraph->AddPass("EarlyCull",
+            {
+                { resources.drawCommands[CULL_PASS_EARLY], RENDER_GRAPH_ACCESS_COMPUTE_READ_WRITE },
+                { resources.visibleInstances[CULL_PASS_EARLY], RENDER_GRAPH_ACCESS_COMPUTE_WRITE },
+                { resources.visibility, RENDER_GRAPH_ACCESS_COMPUTE_READ_WRITE },
+                { resources.depthPyramid, RENDER_GRAPH_ACCESS_COMPUTE_READ },
+            },
+            [this](VkCommandBuffer commandBuffer) { RecordCulling(commandBuffer, *_recordingFrame, CULL_PASS_EARLY); });
+
+        _renderGraph->AddPass("EarlyDraw",
+            {
+                { resources.drawCommands[CULL_PASS_EARLY], RENDER_GRAPH_ACCESS_INDIRECT_READ },
+                { resources.visibleInstances[CULL_PASS_EARLY], RENDER_GRAPH_ACCESS_VERTEX_READ },
+                { resources.sceneColor, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_WRITE },
+                { resources.depth, RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_WRITE },
+            },
+            [this](VkCommandBuffer commandBuffer) { RecordDrawPass(commandBuffer, *_recordingFrame, CULL_PASS_EARLY); });
+
+        // Then the objects the pyramid of what was drawn does not hide, and were not drawn yet
+        _renderGraph->AddPass("DepthPyramid",
+            {
+                { resources.depth, RENDER_GRAPH_ACCESS_COMPUTE_SAMPLED_READ },
+                { resources.depthPyramid, RENDER_GRAPH_ACCESS_COMPUTE_READ_WRITE },
+            },
+            [this](VkCommandBuffer commandBuffer) { RecordDepthPyramid(commandBuffer); });
 
-        // ==== Vertex input ==== //
-        auto bindingDescription = Vertex::GetBindingDescription();
-        auto attributeDescriptions = Vertex::GetAttributeDescriptions();
+        _renderGraph->AddPass("LateCull",
+            {
+                { resources.drawCommands[CULL_PASS_LATE], RENDER_GRAPH_ACCESS_COMPUTE_READ_WRITE },
+                { resources.visibleInstances[CULL_PASS_LATE], RENDER_GRAPH_ACCESS_COMPUTE_WRITE },
+                { resources.visibility, RENDER_GRAPH_ACCESS_COMPUTE_READ_WRITE },
+                { resources.depthPyramid, RENDER_GRAPH_ACCESS_COMPUTE_READ },
+            },
+            [this](VkCommandBuffer commandBuffer) { RecordCulling(commandBuffer, *_recordingFrame, CULL_PASS_LATE); });
+
+        _renderGraph->AddPass("LateDraw",
+            {
+                { resources.drawCommands[CULL_PASS_LATE], RENDER_GRAPH_ACCESS_INDIRECT_READ },
+                { resources.visibleInstances[CULL_PASS_LATE], RENDER_GRAPH_ACCESS_VERTEX_READ },
+                { resources.sceneColor, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT_READ_WRITE },
+                { resources.depth, RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT_READ_WRITE },
+            },
+            [this](VkCommandBuffer commandBuffer) { RecordDrawPass(commandBuffer, *_recordingFrame, CULL_PASS_LATE); });
+
+        _renderGraph->AddPass("Upscale",
+            {
+                { resources.sceneColor, RENDER_GRAPH_ACCESS_TRANSFER_READ },
+                { resources.swapChainImage, RENDER_GRAPH_ACCESS_TRANSFER_WRITE },
+            },
+            [this](VkCommandBuffer commandBuffer) { RecordUpscale(commandBuffer, _renderGraph->GetImage(_graphResources.swapChainImage)); });
 
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo {};
-        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 1;
-        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+        _renderGraph->Compile();
+    }
 
-        // ==== Input assembly ==== //
-        VkPipelineInputAssemblyStateCreateInfo inputAssembly {};
-        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST; // See VK_PRIMITIVE_TOPOLOGY for other types
-        inputAssembly.primitiveRestartEnable = VK_FALSE;
+    VkFilter Application::ChooseUpscaleFilter(VkFormat format)
+    {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(_physicalDevice, format, &properties);
 
-        // ==== Viewports and scissor ==== //
-        // Creating the viewport
-        VkViewport viewport {};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = (float) _swapChainExtent.width;
-        viewport.height = (float) _swapChainExtent.height;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
+        VkFormatFeatureFlags blitFeatures { VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT };
+        if ((properties.optimalTilingFeatures & blitFeatures) != blitFeatures)
+        {
+            throw std::runtime_error("Swap chain format does not support blitting!");
+        }
 
-        // Creating the framebuffer scissor
-        VkRect2D scissor {};
-        scissor.offset = {0, 0};
-        scissor.extent = _swapChainExtent;
+        if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)
+            return VK_FILTER_LINEAR;
+        return VK_FILTER_NEAREST;
+    }
 
-        // Combining viewport and scissor
-        VkPipelineViewportStateCreateInfo viewportState {};
-        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewportState.viewportCount = 1;
-        viewportState.pViewports = &viewport;
-        viewportState.scissorCount = 1;
-        viewportState.pScissors = &scissor;
+    void Application::ReflectShaders()
+    {
+        // Union of every shader permutation : all the pipelines share one layout and one descriptor pool
+        ShaderCode vertShaderCode { _shaderManager.Load(VERT_SHADER_PATH, VK_SHADER_STAGE_VERTEX_BIT) };
+        _shaderReflection = ShaderReflection::Reflect(vertShaderCode.words, vertShaderCode.wordCount, VK_SHADER_STAGE_VERTEX_BIT);
 
-        // ==== Rasterizing ==== //
-        VkPipelineRasterizationStateCreateInfo rasterizer {};
-        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizer.depthClampEnable = VK_FALSE;
-        rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        /* Other modes :
-         * VK_POLYGON_MODE_FILL: fill the area of the polygon with fragments
-         * VK_POLYGON_MODE_LINE: polygon edges are drawn as lines
-         * VK_POLYGON_MODE_POINT: polygon vertices are drawn as points
-         * Other modes than fill requires enabling a GPU feature
-         */
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizer.lineWidth = 1.0f;
-        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-        rasterizer.depthBiasEnable = VK_FALSE;
-        rasterizer.depthBiasConstantFactor = 0.0f; // Optional
-        rasterizer.depthBiasClamp = 0.0f; // Optional
-        rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
+        for (uint32_t features = 0; features <= ShaderVariantKey::DEFINE_FEATURES; ++features)
+        {
+            // Only the features compiled as separate binaries change the interface
+            if ((features & ~ShaderVariantKey::DEFINE_FEATURES) != 0)
+                continue;
 
-        // ==== Multisampling ==== //
-        VkPipelineMultisampleStateCreateInfo multisampling {};
-        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-        multisampling.minSampleShading = 1.0f; // Optional
-        multisampling.pSampleMask = nullptr; // Optional
-        multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-        multisampling.alphaToOneEnable = VK_FALSE; // Optional
+            ShaderVariantKey variant {};
+            variant.features = features;
 
-        // ==== Color Blending ==== //
-        VkPipelineColorBlendAttachmentState colorBlendAttachment {};
-        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachment.blendEnable = VK_FALSE;
-        colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-        colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-        colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-        colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
+            ShaderCode fragShaderCode { _shaderManager.Load(FRAG_SHADER_PATH, VK_SHADER_STAGE_FRAGMENT_BIT, variant.GetDefines()) };
+            _shaderReflection.Merge(ShaderReflection::Reflect(fragShaderCode.words, fragShaderCode.wordCount, VK_SHADER_STAGE_FRAGMENT_BIT));
+        }
 
-        // Alpha Blending
-        //      finalColor.rgb = newAlpha * newColor + (1 - newAlpha) * oldColor;
-        //      finalColor.a = newAlpha.a;
-        // colorBlendAttachment.blendEnable = VK_TRUE;
-        // colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-        // colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-        // colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-        // colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-        // colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-        // colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-        // See : https://vulkan-tutorial.com/en/Drawing_a_triangle/Graphics_pipeline_basics/Fixed_functions#page_Color-blending
-        //       https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VkBlendFactor.html
-        //       https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VkBlendOp.html
+        ShaderCode depthVertShaderCode { _shaderManager.Load(DEPTH_VERT_SHADER_PATH, VK_SHADER_STAGE_VERTEX_BIT) };
+        _shaderReflection.Merge(ShaderReflection::Reflect(depthVertShaderCode.words, depthVertShaderCode.wordCount, VK_SHADER_STAGE_VERTEX_BIT));
+    }
 
-        VkPipelineColorBlendStateCreateInfo colorBlending {};
-        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        colorBlending.logicOpEnable = VK_FALSE;
-        colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-        colorBlending.attachmentCount = 1;
-        colorBlending.pAttachments = &colorBlendAttachment;
-        colorBlending.blendConstants[0] = 0.0f; // Optional
-        colorBlending.blendConstants[1] = 0.0f; // Optional
-        colorBlending.blendConstants[2] = 0.0f; // Optional
-        colorBlending.blendConstants[3] = 0.0f; // Optional
+    void Application::CreateDescriptorSetLayout()
+    {
+        // Bindings and their stages come from the shaders, see ReflectShaders
+        if (_shaderReflection.GetSetCount() > 1)
+        {
+            throw std::runtime_error("Shaders use more than one descriptor set, only set 0 is allocated!");
+        }
 
-        // ==== Dynamic state ==== //
-        // No current usage, for more see :
-        //      https://vulkan-tutorial.com/en/Drawing_a_triangle/Graphics_pipeline_basics/Fixed_functions#page_Dynamic-state
-        //      https://www.khronos.org/registry/vulkan/specs/1.0/man/html/VkPipelineDynamicStateCreateInfo.html
+        _descriptorSetLayout = _layoutCache->GetDescriptorSetLayout(_shaderReflection.GetSetBindings(0));
+    }
 
-        // VkDynamicState dynamicStates[] = {
-        //     VK_DYNAMIC_STATE_VIEWPORT,
-        //     VK_DYNAMIC_STATE_LINE_WIDTH
-        // };
+    void Application::CreatePipelineLayout()
+    {
+        // Per-draw data is read from the instance buffer, the shaders declare no push constants
+        _pipelineLayout = _layoutCache->GetPipelineLayout({ _descriptorSetLayout }, _shaderReflection.GetPushConstantRanges());
+    }
 
-        // VkPipelineDynamicStateCreateInfo dynamicState {};
-        // dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        // dynamicState.dynamicStateCount = 2;
-        // dynamicState.pDynamicStates = dynamicStates;
+    PipelineStateKey Application::MakePipelineState(const ShaderVariantKey& variant)
+    {
+        PipelineStateKey state {};
+        state.layout = _pipelineLayout;
+        state.renderPass = _renderPass;
+        state.subpass = 0;
+        state.SetShaderVariant(variant);
+        return state;
+    }
 
-        // ==== Pipeline layout ==== //
+    PipelineStateKey Application::MakeDepthPrePassState()
+    {
+        ShaderVariantKey variant {};
+        variant.features = SHADER_FEATURE_DEPTH_ONLY;
 
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo {};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 1;
-        pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
-        pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-        pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+        PipelineStateKey state { MakePipelineState(variant) };
+        state.colorWriteMask = 0;
+        return state;
+    }
 
-        if (vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS)
-        {
-            throw std::runtime_error("Failed to create pipeline layout!");
-        }
+    PipelineStateKey Application::MakeDepthEqualState(const ShaderVariantKey& variant)
+    {
+        PipelineStateKey state { MakePipelineState(variant) };
+        state.depthWrite = VK_FALSE;
+        state.depthCompareOp = VK_COMPARE_OP_EQUAL;
+        return state;
+    }
 
-        VkPipelineDepthStencilStateCreateInfo depthStencil {};
-        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-        depthStencil.depthTestEnable = VK_TRUE;
-        depthStencil.depthWriteEnable = VK_TRUE;
-        // Convention of 0 is the closest
-        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-        depthStencil.depthBoundsTestEnable = VK_FALSE;
-        depthStencil.minDepthBounds = 0.0f; // Optional
-        depthStencil.maxDepthBounds = 1.0f; // Optional
+    void Application::CreateGraphicsPipelines()
+    {
+        _pipelineStateCache = std::make_unique<PipelineStateCache>(*_pipelineCompiler,
+            [this](const PipelineStateKey& state, std::vector<std::string>& shaders) { return DescribeGraphicsPipeline(state, shaders); });
 
-        // TODO: Stencil buffer operations look for more documentation
-        depthStencil.stencilTestEnable = VK_FALSE;
-        depthStencil.front = {}; // Optional
-        depthStencil.back = {}; // Optional
+        // Every permutation is compiled up front, in parallel
+        std::vector<PipelineStateKey> states;
+        for (uint32_t features = 0; features <= (SHADER_FEATURE_TEXTURED | SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_ALPHA_TEST); ++features)
+        {
+            ShaderVariantKey variant {};
+            variant.features = features;
+            states.push_back(MakePipelineState(variant));
 
-        VkGraphicsPipelineCreateInfo pipelineInfo {};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2;
-        pipelineInfo.pStages = shaderStages;
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
-        pipelineInfo.pViewportState = &viewportState;
-        pipelineInfo.pRasterizationState = &rasterizer;
-        pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pDepthStencilState = &depthStencil; // Optional
-        pipelineInfo.pColorBlendState = &colorBlending;
-        pipelineInfo.pDynamicState = nullptr; // Optional
+            // The alpha tested batches need their fragment shader to discard, they are not part of the depth pre-pass
+            if (!variant.HasFeature(SHADER_FEATURE_ALPHA_TEST))
+                states.push_back(MakeDepthEqualState(variant));
+        }
+        states.push_back(MakeDepthPrePassState());
 
-        pipelineInfo.layout = _pipelineLayout;
+        auto startTime { std::chrono::high_resolution_clock::now() };
 
-        pipelineInfo.renderPass = _renderPass;
-        pipelineInfo.subpass = 0;
+        _pipelineStateCache->Request(states);
+        _pipelineStateCache->WaitAll();
 
-        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-        pipelineInfo.basePipelineIndex = -1; // Optional
+        auto endTime { std::chrono::high_resolution_clock::now() };
+        std::cout << _pipelineStateCache->GetSize() << " graphics pipelines created in "
+                  << std::chrono::duration<float, std::chrono::milliseconds::period>(endTime - startTime).count() << " ms on "
+                  << _threadPool.GetWorkerCount() << " threads"
+                  << (_isPipelineCacheSeeded ? " (pipeline cache loaded from disk)" : " (cold pipeline cache)") << std::endl;
+    }
 
-        if (vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS)
+    void Application::DestroyPipelines(const std::vector<std::shared_future<VkPipeline>>& pipelines, bool isDeferred)
+    {
+        for (const std::shared_future<VkPipeline>& pipeline : pipelines)
         {
-            throw std::runtime_error("Failed to create graphics pipeline!");
+            // Waits for the pipeline if it is still being compiled
+            if (isDeferred)
+                DeferDestroy([=]() { vkDestroyPipeline(_device, pipeline.get(), nullptr); });
+            else
+                vkDestroyPipeline(_device, pipeline.get(), nullptr);
         }
-
-        vkDestroyShaderModule(_device, fragShaderModule, nullptr);
-        vkDestroyShaderModule(_device, vertShaderModule, nullptr);
     }
 
-    void Application::CreateFramebuffers()
+    void Application::CreateCullPipelineLayout()
     {
-        _swapChainFramebuffers.resize(_swapChainImageViews.size());
-
-        for (size_t i = 0; i < _swapChainImageViews.size(); i++) {
-            std::array<VkImageView, 2> attachments {
-                _swapChainImageViews[i],
-                _depthImageView,
-            };
+        ShaderCode cullShaderCode { _shaderManager.Load(CULL_SHADER_PATH, VK_SHADER_STAGE_COMPUTE_BIT) };
+        _cullReflection = ShaderReflection::Reflect(cullShaderCode.words, cullShaderCode.wordCount, VK_SHADER_STAGE_COMPUTE_BIT);
 
-            VkFramebufferCreateInfo framebufferInfo {};
-            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferInfo.renderPass = _renderPass;
-            framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-            framebufferInfo.pAttachments = attachments.data();
-            framebufferInfo.width = _swapChainExtent.width;
-            framebufferInfo.height = _swapChainExtent.height;
-            framebufferInfo.layers = 1;
+        if (_cullReflection.GetSetCount() != 2)
+        {
+            throw std::runtime_error("Culling shader must use two descriptor sets, the frame buffers and the depth pyramid!");
+        }
 
-            if (vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &_swapChainFramebuffers[i]) != VK_SUCCESS)
+        for (const VkPushConstantRange& range : _cullReflection.GetPushConstantRanges())
+        {
+            if (range.offset + range.size > sizeof(CullPushConstants))
             {
-                throw std::runtime_error("Failed to create framebuffer!");
+                throw std::runtime_error("Culling shader push constants do not match CullPushConstants!");
             }
         }
+
+        _cullDescriptorSetLayout = _layoutCache->GetDescriptorSetLayout(_cullReflection.GetSetBindings(0));
+        _cullPyramidDescriptorSetLayout = _layoutCache->GetDescriptorSetLayout(_cullReflection.GetSetBindings(1));
+        _cullPipelineLayout = _layoutCache->GetPipelineLayout(
+            { _cullDescriptorSetLayout, _cullPyramidDescriptorSetLayout },
+            _cullReflection.GetPushConstantRanges());
     }
 
-    void Application::CreateCommandPool()
+    void Application::CreateCullPipeline()
     {
-        QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(_physicalDevice);
+        _cullPipeline = CreateComputePipeline(CULL_SHADER_PATH, _cullPipelineLayout);
+    }
 
-        VkCommandPoolCreateInfo poolInfo {};
-        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-        poolInfo.flags = 0;
-        /*
-         * Possible Flags:
-         * VK_COMMAND_POOL_CREATE_TRANSIENT_BIT: Hint that command buffers are rerecorded with new commands very often (may change memory allocation behavior)
-         * VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT: Allow command buffers to be rerecorded individually, without this flag they all have to be reset together
-         */
+    VkPipeline Application::CreateComputePipeline(const std::string& shaderPath, VkPipelineLayout layout)
+    {
+        ShaderCode shaderCode { _shaderManager.Load(shaderPath, VK_SHADER_STAGE_COMPUTE_BIT) };
 
-        if (vkCreateCommandPool(_device, &poolInfo, nullptr, &_commandPool) != VK_SUCCESS)
+        VkShaderModuleCreateInfo moduleInfo {};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.wordCount * sizeof(uint32_t);
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(_device, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS)
         {
-            throw std::runtime_error("Failed to create command pool!");
+            throw std::runtime_error("failed to create shader module!");
         }
-    }
 
-    void Application::CreateDepthResources()
-    {
-        VkFormat depthFormat { FindDepthFormat() };
+        VkComputePipelineCreateInfo pipelineInfo {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = layout;
 
-        CreateImage(
-            _swapChainExtent.width,
-            _swapChainExtent.height,
-            depthFormat,
-            VK_IMAGE_TILING_OPTIMAL,
-            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            _depthImage,
-            _depthImageMemory);
-        
-        _depthImageView = CreateImageView(_depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+        VkPipeline pipeline;
+        VkResult result { vkCreateComputePipelines(_device, _pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) };
 
-        TransitionImageLayout(
-            _depthImage,
-            depthFormat,
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+        vkDestroyShaderModule(_device, shaderModule, nullptr);
+
+        if (result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create compute pipeline " + shaderPath + "!");
+        }
 
+        return pipeline;
     }
 
-    VkFormat Application::FindDepthFormat()
+    void Application::CreateVisibilityBuffer()
     {
-        return FindSupportedFormat(
-            {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
-            VK_IMAGE_TILING_OPTIMAL,
-            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
-        );
+        VkDeviceSize bufferSize { sizeof(uint32_t) * MAX_OBJECTS };
+
+        CreateBuffer(bufferSize,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            _visibilityBuffer,
+            _visibilityBufferMemory);
+
+        // Nothing visible yet : the first frame draws everything in its late pass
+        VkCommandBuffer commandBuffer { BeginSingleTimeCommands() };
+        vkCmdFillBuffer(commandBuffer, _visibilityBuffer, 0, bufferSize, 0);
+        EndSingleTimeCommands(commandBuffer);
     }
 
-    VkFormat Application::FindSupportedFormat(
-        const std::vector<VkFormat>& candidates,
-        VkImageTiling tiling,
-        VkFormatFeatureFlags features)
+    void Application::CreateDepthReducePipelineLayout()
     {
-        /*
-         * The VkFormatProperties struct contains three fields:
-         * linearTilingFeatures: Use cases that are supported with linear tiling
-         * optimalTilingFeatures: Use cases that are supported with optimal tiling
-         * bufferFeatures: Use cases that are supported for buffers
-         */
-        VkFormatProperties props;
-        for (VkFormat format : candidates)
+        ShaderCode shaderCode { _shaderManager.Load(DEPTH_REDUCE_SHADER_PATH, VK_SHADER_STAGE_COMPUTE_BIT) };
+        _depthReduceReflection = ShaderReflection::Reflect(shaderCode.words, shaderCode.wordCount, VK_SHADER_STAGE_COMPUTE_BIT);
+
+        if (_depthReduceReflection.GetSetCount() > 1)
         {
-            vkGetPhysicalDeviceFormatProperties(_physicalDevice, format, &props);
-            if (tiling == VK_IMAGE_TILING_LINEAR &&
-                (props.linearTilingFeatures & features) == features)
-            {
-                return format;    
-            }
-            else if (tiling == VK_IMAGE_TILING_OPTIMAL &&
-                (props.optimalTilingFeatures & features) == features)
+            throw std::runtime_error("Depth reduction shader uses more than one descriptor set, only set 0 is allocated!");
+        }
+
+        for (const VkPushConstantRange& range : _depthReduceReflection.GetPushConstantRanges())
+        {
+            if (range.offset + range.size > sizeof(DepthReducePushConstants))
             {
-                return format;
+                throw std::runtime_error("Depth reduction shader push constants do not match DepthReducePushConstants!");
             }
         }
 
-        throw std::runtime_error("Failed to find supported format!");
+        _depthReduceDescriptorSetLayout = _layoutCache->GetDescriptorSetLayout(_depthReduceReflection.GetSetBindings(0));
+        _depthReducePipelineLayout = _layoutCache->GetPipelineLayout(
+            { _depthReduceDescriptorSetLayout },
+            _depthReduceReflection.GetPushConstantRanges());
     }
 
-    bool Application::HasStencilComponent(VkFormat format)
+    void Application::CreateDepthReducePipeline()
     {
-        return format == VK_FORMAT_D32_SFLOAT_S8_UINT || 
-               format == VK_FORMAT_D24_UNORM_S8_UINT;
+        _depthReducePipeline = CreateComputePipeline(DEPTH_REDUCE_SHADER_PATH, _depthReducePipelineLayout);
     }
 
-    void Application::CreateTextureImage()
+    void Application::CreateDepthPyramidSampler()
     {
-        int texWidth, texHeight, texChannels;
+        // Only read with texelFetch, the filtering is never used
+        VkSamplerCreateInfo samplerInfo {};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+        if (vkCreateSampler(_device, &samplerInfo, nullptr, &_depthPyramidSampler) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create depth pyramid sampler!");
+        }
+    }
+
+    RenderGraphImageDescription Application::DescribeDepthPyramid()
+    {
+        // Level 0 is the power of two below the extent, so every level is exactly half of the previous one
+        auto previousPowerOfTwo = [](uint32_t value)
+        {
+            uint32_t result { 1 };
+            while (result * 2 <= value)
+            {
+                result *= 2;
+            }
+            return result;
+        };
+
+        RenderGraphImageDescription description {};
+        description.format = VK_FORMAT_R32_SFLOAT;
+        description.extent = { previousPowerOfTwo(_swapChainExtent.width), previousPowerOfTwo(_swapChainExtent.height) };
+        description.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        description.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+
+        description.mipLevels = 1;
+        while ((std::max(description.extent.width, description.extent.height) >> description.mipLevels) > 0)
+        {
+            ++description.mipLevels;
+        }
+        return description;
+    }
+
+    void Application::CreateDepthPyramid()
+    {
+        RenderGraphImageDescription description { DescribeDepthPyramid() };
+        uint32_t mipLevels { description.mipLevels };
+
+        // Written and sampled in the general layout, the render graph transitions it every frame
+        DepthPyramid pyramid {};
+        pyramid.image = _renderGraph->GetImage(_graphResources.depthPyramid);
+        pyramid.width = description.extent.width;
+        pyramid.height = description.extent.height;
+
+        pyramid.imageView = CreateImageView(pyramid.image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels);
+        for (uint32_t level = 0; level < mipLevels; ++level)
+        {
+            pyramid.mipImageViews.push_back(CreateImageView(pyramid.image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1));
+        }
+
+        // One reduction set per level, plus the set the culling pass samples the whole pyramid with
+        uint32_t cullPyramidSet { _cullReflection.FindBinding("uDepthPyramid").set };
+        std::vector<VkDescriptorPoolSize> poolSizes { _depthReduceReflection.GetPoolSizes(mipLevels, 0) };
+        std::vector<VkDescriptorPoolSize> cullPoolSizes { _cullReflection.GetPoolSizes(1, cullPyramidSet) };
+        poolSizes.insert(poolSizes.end(), cullPoolSizes.begin(), cullPoolSizes.end());
+
+        VkDescriptorPoolCreateInfo poolInfo {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = mipLevels + 1;
+
+        if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &pyramid.descriptorPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create descriptor pool!");
+        }
+
+        std::vector<VkDescriptorSetLayout> layouts(mipLevels, _depthReduceDescriptorSetLayout);
+        layouts.push_back(_cullPyramidDescriptorSetLayout);
+
+        VkDescriptorSetAllocateInfo allocInfo {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = pyramid.descriptorPool;
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+        allocInfo.pSetLayouts = layouts.data();
+
+        std::vector<VkDescriptorSet> descriptorSets(layouts.size());
+        if (vkAllocateDescriptorSets(_device, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate descriptor sets!");
+        }
+
+        pyramid.reduceDescriptorSets.assign(descriptorSets.begin(), descriptorSets.begin() + mipLevels);
+        pyramid.cullDescriptorSet = descriptorSets.back();
+
+        const ShaderBinding& inputBinding { _depthReduceReflection.FindBinding("uInput") };
+        const ShaderBinding& outputBinding { _depthReduceReflection.FindBinding("oOutput") };
+        const ShaderBinding& cullPyramidBinding { _cullReflection.FindBinding("uDepthPyramid") };
+
+        // Reserved so the pointers to the elements stay valid
+        std::vector<VkDescriptorImageInfo> imageInfos;
+        imageInfos.reserve(mipLevels * 2 + 1);
+        std::vector<VkWriteDescriptorSet> descriptorWrites;
+
+        auto writeImage = [&](VkDescriptorSet descriptorSet, const ShaderBinding& binding, VkImageView imageView, VkImageLayout layout)
+        {
+            VkDescriptorImageInfo imageInfo {};
+            imageInfo.imageLayout = layout;
+            imageInfo.imageView = imageView;
+            imageInfo.sampler = _depthPyramidSampler;
+            imageInfos.push_back(imageInfo);
+
+            VkWriteDescriptorSet descriptorWrite {};
+            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrite.dstSet = descriptorSet;
+            descriptorWrite.dstBinding = binding.layoutBinding.binding;
+            descriptorWrite.dstArrayElement = 0;
+            descriptorWrite.descriptorType = binding.layoutBinding.descriptorType;
+            descriptorWrite.descriptorCount = 1;
+            descriptorWrite.pImageInfo = &imageInfos.back();
+            descriptorWrites.push_back(descriptorWrite);
+        };
+
+        for (uint32_t level = 0; level < mipLevels; ++level)
+        {
+            if (level == 0)
+                writeImage(pyramid.reduceDescriptorSets[level], inputBinding, _depthImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            else
+                writeImage(pyramid.reduceDescriptorSets[level], inputBinding, pyramid.mipImageViews[level - 1], VK_IMAGE_LAYOUT_GENERAL);
+
+            writeImage(pyramid.reduceDescriptorSets[level], outputBinding, pyramid.mipImageViews[level], VK_IMAGE_LAYOUT_GENERAL);
+        }
+
+        writeImage(pyramid.cullDescriptorSet, cullPyramidBinding, pyramid.imageView, VK_IMAGE_LAYOUT_GENERAL);
+
+        vkUpdateDescriptorSets(_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+        _depthPyramid = pyramid;
+    }
+
+    void Application::DestroyDepthPyramid(const DepthPyramid& depthPyramid)
+    {
+        // Frees the descriptor sets along with the pool
+        vkDestroyDescriptorPool(_device, depthPyramid.descriptorPool, nullptr);
+
+        for (VkImageView imageView : depthPyramid.mipImageViews)
+        {
+            vkDestroyImageView(_device, imageView, nullptr);
+        }
+        // The image belongs to the render graph
+        vkDestroyImageView(_device, depthPyramid.imageView, nullptr);
+    }
+
+    GraphicsPipelineDescription Application::DescribeGraphicsPipeline(const PipelineStateKey& state, std::vector<std::string>& shaders)
+    {
+        GraphicsPipelineDescription description {};
+        description.name = std::to_string(state.Hash());
+
+        ShaderVariantKey variant { state.GetShaderVariant() };
+
+        // ==== Shader Compilation ==== //
+        // Embedded in the executable, or compiled from GLSL at runtime when hot reloading (see ShaderManager).
+        // Only the features that need a #define produce a separate binary.
+        std::vector<ShaderDefine> defines { variant.GetDefines() };
+        bool isDepthOnly { variant.HasFeature(SHADER_FEATURE_DEPTH_ONLY) };
+        const std::string& vertShaderPath { isDepthOnly ? DEPTH_VERT_SHADER_PATH : VERT_SHADER_PATH };
+
+        shaders = { ShaderManager::MakeKey(vertShaderPath, {}) };
+        if (!isDepthOnly)
+            shaders.push_back(ShaderManager::MakeKey(FRAG_SHADER_PATH, defines));
+
+        ShaderStageDescription vertShaderStage {};
+        vertShaderStage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertShaderStage.code = _shaderManager.Load(vertShaderPath, VK_SHADER_STAGE_VERTEX_BIT);
+
+        ShaderStageDescription fragShaderStage {};
+        fragShaderStage.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        if (!isDepthOnly)
+            fragShaderStage.code = _shaderManager.Load(FRAG_SHADER_PATH, VK_SHADER_STAGE_FRAGMENT_BIT, defines);
+
+        // ==== Specialization constants ==== //
+        // The driver folds them when compiling the pipeline, unused paths are dead code for this variant
+        ShaderSpecialization specialization { variant };
+        auto specializationMapEntries = ShaderSpecialization::GetMapEntries();
+
+        fragShaderStage.specializationMapEntries.assign(specializationMapEntries.begin(), specializationMapEntries.end());
+        fragShaderStage.specializationData.resize(sizeof(specialization));
+        memcpy(fragShaderStage.specializationData.data(), &specialization, sizeof(specialization));
+
+        // ==== Vertex input ==== //
+        // Only the attributes the vertex shader reads are fetched
+        ShaderReflection vertReflection { ShaderReflection::Reflect(vertShaderStage.code.words, vertShaderStage.code.wordCount, VK_SHADER_STAGE_VERTEX_BIT) };
+
+        switch (state.vertexLayout)
+        {
+            case VERTEX_LAYOUT_STANDARD:
+            default:
+            {
+                auto attributeDescriptions = Vertex::GetAttributeDescriptions();
+                description.vertexBindings = { Vertex::GetBindingDescription() };
+
+                for (const ShaderVertexInput& input : vertReflection.GetVertexInputs())
+                {
+                    auto attribute { std::find_if(attributeDescriptions.begin(), attributeDescriptions.end(),
+                        [&](const VkVertexInputAttributeDescription& attribute) { return attribute.location == input.location; }) };
+
+                    if (attribute == attributeDescriptions.end() || attribute->format != input.format)
+                    {
+                        throw std::runtime_error("Vertex input " + input.name + " does not match the Vertex layout!");
+                    }
+
+                    description.vertexAttributes.push_back(*attribute);
+                }
+                break;
+            }
+        }
+
+        // Depth only : no fragment shader, the rasterizer still writes the depth
+        if (isDepthOnly)
+            description.stages = { std::move(vertShaderStage) };
+        else
+            description.stages = { std::move(vertShaderStage), std::move(fragShaderStage) };
+
+        // ==== Input assembly ==== //
+        VkPipelineInputAssemblyStateCreateInfo& inputAssembly { description.inputAssembly };
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = static_cast<VkPrimitiveTopology>(state.topology); // See VK_PRIMITIVE_TOPOLOGY for other types
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        // ==== Viewports and scissor ==== //
+        // Both are dynamic (see below) so the pipeline does not depend on the swap chain extent
+        description.viewportCount = 1;
+
+        // ==== Rasterizing ==== //
+        VkPipelineRasterizationStateCreateInfo& rasterizer { description.rasterizer };
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        /* Other modes :
+         * VK_POLYGON_MODE_FILL: fill the area of the polygon with fragments
+         * VK_POLYGON_MODE_LINE: polygon edges are drawn as lines
+         * VK_POLYGON_MODE_POINT: polygon vertices are drawn as points
+         * Other modes than fill requires enabling a GPU feature
+         */
+        rasterizer.polygonMode = static_cast<VkPolygonMode>(state.polygonMode);
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = state.cullMode;
+        rasterizer.frontFace = static_cast<VkFrontFace>(state.frontFace);
+        rasterizer.depthBiasEnable = VK_FALSE;
+        rasterizer.depthBiasConstantFactor = 0.0f; // Optional
+        rasterizer.depthBiasClamp = 0.0f; // Optional
+        rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
+
+        // ==== Multisampling ==== //
+        VkPipelineMultisampleStateCreateInfo& multisampling { description.multisampling };
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = static_cast<VkSampleCountFlagBits>(state.sampleCount);
+        multisampling.minSampleShading = 1.0f; // Optional
+        multisampling.pSampleMask = nullptr; // Optional
+        multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
+        multisampling.alphaToOneEnable = VK_FALSE; // Optional
+
+        // ==== Color Blending ==== //
+        VkPipelineColorBlendAttachmentState colorBlendAttachment {};
+        colorBlendAttachment.colorWriteMask = state.colorWriteMask;
+        colorBlendAttachment.blendEnable = VK_FALSE;
+        colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
+        colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
+        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
+        colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
+        colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
+        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
+
+        switch (state.blendMode)
+        {
+            // Alpha Blending
+            //      finalColor.rgb = newAlpha * newColor + (1 - newAlpha) * oldColor;
+            //      finalColor.a = newAlpha.a;
+            case BLEND_MODE_ALPHA:
+                colorBlendAttachment.blendEnable = VK_TRUE;
+                colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+                colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+                break;
+
+            //      finalColor.rgb = newAlpha * newColor + oldColor;
+            case BLEND_MODE_ADDITIVE:
+                colorBlendAttachment.blendEnable = VK_TRUE;
+                colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+                colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+                break;
+
+            default:
+                break;
+        }
+        // See : https://vulkan-tutorial.com/en/Drawing_a_triangle/Graphics_pipeline_basics/Fixed_functions#page_Color-blending
+        //       https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VkBlendFactor.html
+        //       https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VkBlendOp.html
+
+        description.colorBlendAttachments = { colorBlendAttachment };
+
+        VkPipelineColorBlendStateCreateInfo& colorBlending { description.colorBlending };
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
+        colorBlending.blendConstants[0] = 0.0f; // Optional
+        colorBlending.blendConstants[1] = 0.0f; // Optional
+        colorBlending.blendConstants[2] = 0.0f; // Optional
+        colorBlending.blendConstants[3] = 0.0f; // Optional
+
+        // ==== Dynamic state ==== //
+        // Viewport and scissor are set when recording, so resizing the window keeps this pipeline
+        // See : https://www.khronos.org/registry/vulkan/specs/1.0/man/html/VkPipelineDynamicStateCreateInfo.html
+        description.dynamicStates =
+        {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR
+        };
+
+        VkPipelineDepthStencilStateCreateInfo& depthStencil { description.depthStencil };
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = state.depthTest;
+        depthStencil.depthWriteEnable = state.depthWrite;
+        // Convention of 0 is the closest
+        depthStencil.depthCompareOp = static_cast<VkCompareOp>(state.depthCompareOp);
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.minDepthBounds = 0.0f; // Optional
+        depthStencil.maxDepthBounds = 1.0f; // Optional
+
+        // TODO: Stencil buffer operations look for more documentation
+        depthStencil.stencilTestEnable = VK_FALSE;
+        depthStencil.front = {}; // Optional
+        depthStencil.back = {}; // Optional
+
+        description.layout = state.layout;
+
+        description.renderPass = state.renderPass;
+        description.subpass = state.subpass;
+
+        return description;
+    }
+
+    void Application::CreateFramebuffers()
+    {
+        // The scene is rendered offscreen, one framebuffer whatever the swap chain image
+        _sceneColorImageView = CreateImageView(
+            _renderGraph->GetImage(_graphResources.sceneColor), _swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        std::array<VkImageView, 2> attachments {
+            _sceneColorImageView,
+            _depthImageView,
+        };
+
+        VkFramebufferCreateInfo framebufferInfo {};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = _renderPass;
+        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        framebufferInfo.pAttachments = attachments.data();
+        framebufferInfo.width = _swapChainExtent.width;
+        framebufferInfo.height = _swapChainExtent.height;
+        framebufferInfo.layers = 1;
+
+        if (vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &_sceneFramebuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create framebuffer!");
+        }
+    }
+
+    void Application::CreateCommandPool()
+    {
+        QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(_physicalDevice);
+
+        VkCommandPoolCreateInfo poolInfo {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+        // Single time commands, freed right after their submission completes
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        /*
+         * Possible Flags:
+         * VK_COMMAND_POOL_CREATE_TRANSIENT_BIT: Hint that command buffers are rerecorded with new commands very often (may change memory allocation behavior)
+         * VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT: Allow command buffers to be rerecorded individually, without this flag they all have to be reset together
+         */
+
+        if (vkCreateCommandPool(_device, &poolInfo, nullptr, &_commandPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create command pool!");
+        }
+    }
+
+    void Application::CreateDepthResources()
+    {
+        // Created and transitioned by the render graph, only the view is ours
+        _depthImage = _renderGraph->GetImage(_graphResources.depth);
+        _depthImageView = CreateImageView(_depthImage, FindDepthFormat(), VK_IMAGE_ASPECT_DEPTH_BIT);
+    }
+
+    VkFormat Application::FindDepthFormat()
+    {
+        return FindSupportedFormat(
+            {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
+        );
+    }
+
+    VkFormat Application::FindSupportedFormat(
+        const std::vector<VkFormat>& candidates,
+        VkImageTiling tiling,
+        VkFormatFeatureFlags features)
+    {
+        /*
+         * The VkFormatProperties struct contains three fields:
+         * linearTilingFeatures: Use cases that are supported with linear tiling
+         * optimalTilingFeatures: Use cases that are supported with optimal tiling
+         * bufferFeatures: Use cases that are supported for buffers
+         */
+        VkFormatProperties props;
+        for (VkFormat format : candidates)
+        {
+            vkGetPhysicalDeviceFormatProperties(_physicalDevice, format, &props);
+            if (tiling == VK_IMAGE_TILING_LINEAR &&
+                (props.linearTilingFeatures & features) == features)
+            {
+                return format;    
+            }
+            else if (tiling == VK_IMAGE_TILING_OPTIMAL &&
+                (props.optimalTilingFeatures & features) == features)
+            {
+                return format;
+            }
+        }
+
+        throw std::runtime_error("Failed to find supported format!");
+    }
+
+    bool Application::HasStencilComponent(VkFormat format)
+    {
+        return format == VK_FORMAT_D32_SFLOAT_S8_UINT || 
+               format == VK_FORMAT_D24_UNORM_S8_UINT;
+    }
+
+    void Application::CreateTextureImage()
+    {
+        int texWidth, texHeight, texChannels;
         unsigned char* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
         VkDeviceSize imageSize = texWidth * texHeight * 4;
 
@@ -1099,7 +1727,8 @@ namespace Vulkan
         VkImageUsageFlags usage,
         VkMemoryPropertyFlags properties,
         VkImage& image,
-        VkDeviceMemory& imageMemory)
+        VkDeviceMemory& imageMemory,
+        uint32_t mipLevels)
     {
         VkImageCreateInfo imageInfo {};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1107,7 +1736,7 @@ namespace Vulkan
         imageInfo.extent.width = static_cast<uint32_t>(width);
         imageInfo.extent.height = static_cast<uint32_t>(height);
         imageInfo.extent.depth = 1;
-        imageInfo.mipLevels = 1;
+        imageInfo.mipLevels = mipLevels;
         imageInfo.arrayLayers = 1;
         imageInfo.format = format; // Format
         /*
@@ -1165,7 +1794,7 @@ namespace Vulkan
 
         barrier.image = image;
         barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
         barrier.subresourceRange.baseArrayLayer = 0;
         barrier.subresourceRange.layerCount = 1;
 
@@ -1212,6 +1841,15 @@ namespace Vulkan
             sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
             destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
         }
+        else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
+            newLayout == VK_IMAGE_LAYOUT_GENERAL)
+        {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            destinationStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        }
         else 
         {
             throw std::invalid_argument("Unsupported layout transition!");
@@ -1318,7 +1956,12 @@ namespace Vulkan
         }
     }
 
-    VkImageView Application::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) 
+    VkImageView Application::CreateImageView(
+        VkImage image,
+        VkFormat format,
+        VkImageAspectFlags aspectFlags,
+        uint32_t baseMipLevel,
+        uint32_t levelCount)
     {
         VkImageViewCreateInfo viewInfo = {};
         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -1326,8 +1969,8 @@ namespace Vulkan
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
         viewInfo.format = format;
         viewInfo.subresourceRange.aspectMask = aspectFlags;
-        viewInfo.subresourceRange.baseMipLevel = 0;
-        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
+        viewInfo.subresourceRange.levelCount = levelCount;
         viewInfo.subresourceRange.baseArrayLayer = 0;
         viewInfo.subresourceRange.layerCount = 1;
 
@@ -1342,142 +1985,186 @@ namespace Vulkan
 
     void Application::LoadModel()
     {
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string warn, err;
+        ObjStreamReader reader { MODEL_PATH };
 
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str()))
+        // First pass counts, so the device buffers get their exact final size, and spills the attributes to disk
+        const ObjStreamReader::Counts& counts { reader.Scan() };
+        if (counts.indices == 0)
         {
-            throw std::runtime_error(warn + err);
+            throw std::runtime_error("Model has no faces: " + MODEL_PATH);
         }
 
-        std::unordered_map<Vertex, uint32_t> uniqueVertices {};
-        for (const auto& shape : shapes)
-        {
-            for (const auto& index : shape.mesh.indices)
-            {
-                Vertex vertex {};
-                vertex.position =
-                {
-                    attrib.vertices[3 * index.vertex_index + 0],
-                    attrib.vertices[3 * index.vertex_index + 1],
-                    attrib.vertices[3 * index.vertex_index + 2],
-                };
+        _modelMesh.id = 0;
+        _modelMesh.indexCount = counts.indices;
+        _modelMesh.firstIndex = 0;
+        _modelMesh.vertexOffset = 0;
 
-                vertex.uv =
-                {
-                    attrib.texcoords[2 * index.texcoord_index + 0],
-                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1],
-                };
+        VkDeviceSize vertexBufferSize { sizeof(Vertex) * static_cast<VkDeviceSize>(counts.vertices) };
+        VkDeviceSize indexBufferSize  { sizeof(uint32_t) * static_cast<VkDeviceSize>(counts.indices) };
 
-                vertex.color = { 1.0f, 1.0f, 1.0f };
-
-                if (uniqueVertices.count(vertex) == 0)
-                {
-                    uniqueVertices[vertex] = static_cast<uint32_t>(_vertices.size());
-                    _vertices.push_back(std::move(vertex));
-                }
+        CreateBuffer(vertexBufferSize,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            _vertexBuffer,
+            _vertexBufferMemory);
 
-                _indices.push_back(uniqueVertices[vertex]);
-            }
-        }
-    }
+        CreateBuffer(indexBufferSize,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            _indexBuffer,
+            _indexBufferMemory);
 
-    void Application::CreateVertexBuffer()
-    {
-        VkDeviceSize bufferSize { sizeof(_vertices[0]) * _vertices.size() };
+        // A single fixed-size staging buffer, split between vertices and indices.
+        // Each half is flushed to the device buffers every time the reader fills it.
+        VkDeviceSize vertexStagingSize { (MODEL_STAGING_SIZE / 2) / sizeof(Vertex) * sizeof(Vertex) };
+        VkDeviceSize indexStagingSize  { (MODEL_STAGING_SIZE / 2) / sizeof(uint32_t) * sizeof(uint32_t) };
 
         VkBuffer stagingBuffer;
         VkDeviceMemory stagingBufferMemory;
-
-        /*
-         * Buffer usage flags:
-         * VK_BUFFER_USAGE_TRANSFER_SRC_BIT: Buffer can be used as source in a memory transfer operation.
-         * VK_BUFFER_USAGE_TRANSFER_DST_BIT: Buffer can be used as destination in a memory transfer operation.
-         */
-        CreateBuffer(bufferSize, 
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-            stagingBuffer, 
+        CreateBuffer(vertexStagingSize + indexStagingSize,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            stagingBuffer,
             stagingBufferMemory);
 
         void* data;
-        vkMapMemory(_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, _vertices.data(), bufferSize);
-        vkUnmapMemory(_device, stagingBufferMemory);
+        vkMapMemory(_device, stagingBufferMemory, 0, vertexStagingSize + indexStagingSize, 0, &data);
 
-        CreateBuffer(bufferSize, 
-            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            _vertexBuffer, 
-            _vertexBufferMemory);
+        Vertex*   vertexStaging { static_cast<Vertex*>(data) };
+        uint32_t* indexStaging  { reinterpret_cast<uint32_t*>(static_cast<char*>(data) + vertexStagingSize) };
+
+        VkDeviceSize vertexOffset { 0 };
+        VkDeviceSize indexOffset  { 0 };
+
+        // Bounds of the model, gathered while the vertices go through the staging buffer
+        glm::vec3 boundsMin { std::numeric_limits<float>::max() };
+        glm::vec3 boundsMax { std::numeric_limits<float>::lowest() };
+
+        // CopyBuffer waits for the queue to be idle, so the staging memory can be refilled right after
+        reader.Stream(
+            vertexStaging, vertexStagingSize / sizeof(Vertex),
+            [&](size_t count)
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    boundsMin = glm::min(boundsMin, vertexStaging[i].position);
+                    boundsMax = glm::max(boundsMax, vertexStaging[i].position);
+                }
+
+                VkDeviceSize size { sizeof(Vertex) * count };
+                CopyBuffer(stagingBuffer, _vertexBuffer, size, 0, vertexOffset);
+                vertexOffset += size;
+            },
+            indexStaging, indexStagingSize / sizeof(uint32_t),
+            [&](size_t count)
+            {
+                VkDeviceSize size { sizeof(uint32_t) * count };
+                CopyBuffer(stagingBuffer, _indexBuffer, size, vertexStagingSize, indexOffset);
+                indexOffset += size;
+            });
 
-        CopyBuffer(stagingBuffer, _vertexBuffer, bufferSize);
+        vkUnmapMemory(_device, stagingBufferMemory);
 
         vkDestroyBuffer(_device, stagingBuffer, nullptr);
         vkFreeMemory(_device, stagingBufferMemory, nullptr);
+
+        _modelMesh.boundingSphere = glm::vec4((boundsMin + boundsMax) * 0.5f, glm::length(boundsMax - boundsMin) * 0.5f);
     }
 
-    void Application::CreateIndexBuffer()
+    void Application::CreateScene()
     {
-         VkDeviceSize bufferSize = sizeof(_indices[0]) * _indices.size();
-
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        CreateBuffer(bufferSize,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            stagingBuffer,
-            stagingBufferMemory);
+        _modelTransform = _transforms.Add(TransformHierarchy::NO_PARENT);
+        SpawnInstances(_modelMesh, _shaderVariant, { _modelTransform });
+    }
 
-        void* data;
-        vkMapMemory(_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, _indices.data(), (size_t) bufferSize);
-        vkUnmapMemory(_device, stagingBufferMemory);
+    size_t Application::SpawnInstances(const Mesh& mesh, const ShaderVariantKey& variant, const std::vector<uint32_t>& transforms)
+    {
+        if (_nextObjectId + transforms.size() > MAX_OBJECTS)
+        {
+            throw std::runtime_error("Cannot spawn more than MAX_OBJECTS objects!");
+        }
 
-        CreateBuffer(bufferSize,
-            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            _indexBuffer,
-            _indexBufferMemory);
+        size_t firstObject { _renderList.size() };
+        _renderList.reserve(firstObject + transforms.size());
 
-        CopyBuffer(stagingBuffer, _indexBuffer, bufferSize);
+        for (uint32_t transform : transforms)
+        {
+            RenderObject object {};
+            object.transform = transform;
+            object.objectId = _nextObjectId++;
+            object.variant = variant;
+            object.mesh = mesh;
+            _renderList.push_back(object);
+        }
 
-        vkDestroyBuffer(_device, stagingBuffer, nullptr);
-        vkFreeMemory(_device, stagingBufferMemory, nullptr);
+        return firstObject;
     }
 
     void Application::CreateUniformBuffer()
     {
         VkDeviceSize bufferSize = sizeof(UniformBufferObject);
 
-        _uniformBuffers.resize(_swapChainImages.size());
-        _uniformBuffersMemory.resize(_swapChainImages.size());
-
-        for (size_t i = 0; i < _swapChainImages.size(); ++i)
+        // Written by the CPU every frame : one buffer per frame in flight, not per swap chain image
+        for (FrameResources& frame : _frames)
         {
             CreateBuffer(bufferSize,
                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-                _uniformBuffers[i], 
-                _uniformBuffersMemory[i]);
+                frame.uniformBuffer, 
+                frame.uniformBufferMemory);
+
+            vkMapMemory(_device, frame.uniformBufferMemory, 0, bufferSize, 0, &frame.uniformBufferMapped);
+        }
+    }
+
+    void Application::CreateInstanceBuffers()
+    {
+        VkDeviceSize instanceBufferSize { sizeof(InstanceData) * MAX_INSTANCES };
+        VkDeviceSize drawCommandBufferSize { sizeof(VkDrawIndexedIndirectCommand) * MAX_DRAW_BATCHES * CULL_PASS_COUNT };
+        VkDeviceSize visibleInstanceBufferSize { sizeof(uint32_t) * MAX_INSTANCES * CULL_PASS_COUNT };
+
+        for (FrameResources& frame : _frames)
+        {
+            CreateBuffer(instanceBufferSize,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                frame.instanceBuffer,
+                frame.instanceBufferMemory);
+
+            // Reset with vkCmdUpdateBuffer every frame, then only the GPU writes it
+            CreateBuffer(drawCommandBufferSize,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                frame.drawCommandBuffer,
+                frame.drawCommandBufferMemory);
+
+            CreateBuffer(visibleInstanceBufferSize,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                frame.visibleInstanceBuffer,
+                frame.visibleInstanceBufferMemory);
+
+            void* data;
+            vkMapMemory(_device, frame.instanceBufferMemory, 0, instanceBufferSize, 0, &data);
+            frame.instances = static_cast<InstanceData*>(data);
         }
     }
 
     void Application::CreateDescriptorPool()
     {
-        std::array<VkDescriptorPoolSize, 2> poolSizes {};
-        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSizes[0].descriptorCount = static_cast<uint32_t>(_swapChainImages.size());
-        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        poolSizes[1].descriptorCount = static_cast<uint32_t>(_swapChainImages.size());
+        // Exactly what one descriptor set per frame in flight needs, for the union of all the pipelines
+        uint32_t setCopies { MAX_FRAMES_IN_FLIGHT };
+        std::vector<VkDescriptorPoolSize> poolSizes { _shaderReflection.GetPoolSizes(setCopies) };
+
+        // Plus the frame set of the culling pass, its depth pyramid set comes from the pool of the pyramid
+        std::vector<VkDescriptorPoolSize> cullPoolSizes { _cullReflection.GetPoolSizes(setCopies, 0) };
+        poolSizes.insert(poolSizes.end(), cullPoolSizes.begin(), cullPoolSizes.end());
 
         VkDescriptorPoolCreateInfo poolInfo {};
         poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
         poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
         poolInfo.pPoolSizes = poolSizes.data();
-        poolInfo.maxSets = static_cast<uint32_t>(_swapChainImages.size());
+        poolInfo.maxSets = setCopies * (_shaderReflection.GetSetCount() + 1);
 
         if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS)
         {
@@ -1487,52 +2174,89 @@ namespace Vulkan
 
     void Application::CreateDescriptorSets()
     {
-        std::vector<VkDescriptorSetLayout> layouts(_swapChainImages.size(), _descriptorSetLayout);
+        std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT * 2> layouts;
+        std::fill(layouts.begin(), layouts.begin() + MAX_FRAMES_IN_FLIGHT, _descriptorSetLayout);
+        std::fill(layouts.begin() + MAX_FRAMES_IN_FLIGHT, layouts.end(), _cullDescriptorSetLayout);
         VkDescriptorSetAllocateInfo allocInfo {};
         allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
         allocInfo.descriptorPool = _descriptorPool;
-        allocInfo.descriptorSetCount = static_cast<uint32_t>(_swapChainImages.size());
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
         allocInfo.pSetLayouts = layouts.data();
 
-        _descriptorSets.resize(_swapChainImages.size());
+        // The graphics sets of every frame, then their culling sets
+        std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT * 2> descriptorSets;
 
-        if (vkAllocateDescriptorSets(_device, &allocInfo, _descriptorSets.data()) != VK_SUCCESS)
+        if (vkAllocateDescriptorSets(_device, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
         {
             throw std::runtime_error("Failed to allocate descriptor sets!");
         }
 
-        for (size_t i = 0; i < _swapChainImages.size(); i++)
+        // Resources are matched with the shaders by name
+        const ShaderBinding& uboBinding { _shaderReflection.FindBinding("iUBO") };
+        const ShaderBinding& textureBinding { _shaderReflection.FindBinding("uTexture") };
+        const ShaderBinding& instanceBinding { _shaderReflection.FindBinding("iInstances") };
+        const ShaderBinding& visibleInstanceBinding { _shaderReflection.FindBinding("iVisibleInstances") };
+
+        const ShaderBinding& cullInstanceBinding { _cullReflection.FindBinding("iInstances") };
+        const ShaderBinding& cullCommandBinding { _cullReflection.FindBinding("oCommands") };
+        const ShaderBinding& cullVisibleInstanceBinding { _cullReflection.FindBinding("oVisibleInstances") };
+        const ShaderBinding& cullVisibilityBinding { _cullReflection.FindBinding("ioVisibility") };
+        const ShaderBinding& cullUboBinding { _cullReflection.FindBinding("iUBO") };
+
+        for (size_t i = 0; i < _frames.size(); i++)
         {
-            VkDescriptorBufferInfo bufferInfo {};
-            bufferInfo.buffer = _uniformBuffers[i];
-            bufferInfo.offset = 0;
-            bufferInfo.range = sizeof(UniformBufferObject);
+            FrameResources& frame { _frames[i] };
+            frame.descriptorSet = descriptorSets[i];
+            frame.cullDescriptorSet = descriptorSets[MAX_FRAMES_IN_FLIGHT + i];
+
+            // Reserved so the pointers to the elements stay valid
+            std::vector<VkDescriptorBufferInfo> bufferInfos;
+            bufferInfos.reserve(8);
+            std::vector<VkWriteDescriptorSet> descriptorWrites;
+
+            auto writeBuffer = [&](VkDescriptorSet descriptorSet, const ShaderBinding& binding, VkBuffer buffer)
+            {
+                VkDescriptorBufferInfo bufferInfo {};
+                bufferInfo.buffer = buffer;
+                bufferInfo.offset = 0;
+                bufferInfo.range = VK_WHOLE_SIZE;
+                bufferInfos.push_back(bufferInfo);
+
+                VkWriteDescriptorSet descriptorWrite {};
+                descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrite.dstSet = descriptorSet;
+                descriptorWrite.dstBinding = binding.layoutBinding.binding;
+                descriptorWrite.dstArrayElement = 0;
+                descriptorWrite.descriptorType = binding.layoutBinding.descriptorType;
+                descriptorWrite.descriptorCount = 1;
+                descriptorWrite.pBufferInfo = &bufferInfos.back(); // Field is used for descriptors that refer to buffer data
+                descriptorWrites.push_back(descriptorWrite);
+            };
+
+            writeBuffer(frame.descriptorSet, uboBinding, frame.uniformBuffer);
+            writeBuffer(frame.descriptorSet, instanceBinding, frame.instanceBuffer);
+            writeBuffer(frame.descriptorSet, visibleInstanceBinding, frame.visibleInstanceBuffer);
+
+            writeBuffer(frame.cullDescriptorSet, cullInstanceBinding, frame.instanceBuffer);
+            writeBuffer(frame.cullDescriptorSet, cullCommandBinding, frame.drawCommandBuffer);
+            writeBuffer(frame.cullDescriptorSet, cullVisibleInstanceBinding, frame.visibleInstanceBuffer);
+            writeBuffer(frame.cullDescriptorSet, cullVisibilityBinding, _visibilityBuffer);
+            writeBuffer(frame.cullDescriptorSet, cullUboBinding, frame.uniformBuffer);
 
             VkDescriptorImageInfo imageInfo {};
             imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
             imageInfo.imageView = _textureImageView;
             imageInfo.sampler = _textureSampler;
 
-            std::array<VkWriteDescriptorSet, 2> descriptorWrites {};
-            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = _descriptorSets[i];
-            descriptorWrites[0].dstBinding = 0;
-            descriptorWrites[0].dstArrayElement = 0;
-            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrites[0].descriptorCount = 1;
-            descriptorWrites[0].pBufferInfo = &bufferInfo;  // Field is used for descriptors that refer to buffer data
-            descriptorWrites[0].pImageInfo = nullptr;       // Is used for descriptors that refer to image data
-            descriptorWrites[0].pTexelBufferView = nullptr; // Is used for descriptors that refer to buffer views
-
-            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[1].dstSet = _descriptorSets[i];
-            descriptorWrites[1].dstBinding = 1;
-            descriptorWrites[1].dstArrayElement = 0;
-            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptorWrites[1].descriptorCount = 1;
-            descriptorWrites[1].pBufferInfo = nullptr;      // Field is used for descriptors that refer to buffer data
-            descriptorWrites[1].pImageInfo = &imageInfo;    // Is used for descriptors that refer to image data
-            descriptorWrites[1].pTexelBufferView = nullptr; // Is used for descriptors that refer to buffer views
+            VkWriteDescriptorSet textureWrite {};
+            textureWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            textureWrite.dstSet = frame.descriptorSet;
+            textureWrite.dstBinding = textureBinding.layoutBinding.binding;
+            textureWrite.dstArrayElement = 0;
+            textureWrite.descriptorType = textureBinding.layoutBinding.descriptorType;
+            textureWrite.descriptorCount = 1;
+            textureWrite.pImageInfo = &imageInfo; // Is used for descriptors that refer to image data
+            descriptorWrites.push_back(textureWrite);
 
             vkUpdateDescriptorSets(_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
         }
@@ -1586,11 +2310,13 @@ namespace Vulkan
         throw std::runtime_error("failed to find suitable memory type!");
     }
 
-    void Application::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+    void Application::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset)
     {
         VkCommandBuffer commandBuffer { BeginSingleTimeCommands() };
 
         VkBufferCopy copyRegion {};
+        copyRegion.srcOffset = srcOffset;
+        copyRegion.dstOffset = dstOffset;
         copyRegion.size = size;
         vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
@@ -1600,91 +2326,501 @@ namespace Vulkan
 
     void Application::CreateCommandBuffers()
     {
-        _commandBuffers.resize(_swapChainFramebuffers.size());
+        QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(_physicalDevice);
 
-        VkCommandBufferAllocateInfo allocInfo {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = _commandPool;
+        // Each frame in flight records into its own pool, reset as a whole once the frame has completed.
+        // No RESET_COMMAND_BUFFER_BIT : resetting the pool is cheaper than resetting the buffers one by one.
+        VkCommandPoolCreateInfo poolInfo {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+        for (FrameResources& frame : _frames)
+        {
+            if (vkCreateCommandPool(_device, &poolInfo, nullptr, &frame.commandPool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create frame command pool!");
+            }
+
+            VkCommandBufferAllocateInfo allocInfo {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = frame.commandPool;
+            /*
+             * Possible levels
+             * VK_COMMAND_BUFFER_LEVEL_PRIMARY: Can be submitted to a queue for execution, but cannot be called from other command buffers.
+             * VK_COMMAND_BUFFER_LEVEL_SECONDARY: Cannot be submitted directly, but can be called from primary command buffers.
+             */
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(_device, &allocInfo, &frame.commandBuffer) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to allocate command buffers!");
+            }
+
+            // The draws are recorded in parallel, at most one task per recording thread
+            size_t poolCount { _recordingThreadPool.GetWorkerCount() };
+            frame.secondaryCommandPools.resize(poolCount);
+            frame.secondaryCommandBuffers.resize(poolCount * CULL_PASS_COUNT * DRAW_STAGE_COUNT);
+
+            for (size_t i = 0; i < poolCount; ++i)
+            {
+                if (vkCreateCommandPool(_device, &poolInfo, nullptr, &frame.secondaryCommandPools[i]) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("Failed to create frame command pool!");
+                }
+
+                // The passes are recorded one after the other, a task of each pass uses the pool.
+                // Within a pass, the task records both of its draw stages.
+                allocInfo.commandPool = frame.secondaryCommandPools[i];
+                allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                allocInfo.commandBufferCount = CULL_PASS_COUNT * DRAW_STAGE_COUNT;
+
+                std::array<VkCommandBuffer, CULL_PASS_COUNT * DRAW_STAGE_COUNT> commandBuffers;
+                if (vkAllocateCommandBuffers(_device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("Failed to allocate command buffers!");
+                }
+
+                for (size_t buffer = 0; buffer < commandBuffers.size(); ++buffer)
+                {
+                    frame.secondaryCommandBuffers[buffer * poolCount + i] = commandBuffers[buffer];
+                }
+            }
+        }
+
+        // Recorded in DrawFrame, every frame
+    }
+
+    void Application::CreateQueryPools()
+    {
+        uint32_t queueFamilyCount { 0 };
+        vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(_physicalDevice, &properties);
+
+        uint32_t validBits { queueFamilies[FindQueueFamilies(_physicalDevice).graphicsFamily.value()].timestampValidBits };
+        _hasGpuTimestamps = validBits > 0;
+        _timestampPeriod = properties.limits.timestampPeriod;
+        _timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+        if (!_hasGpuTimestamps)
+        {
+            std::cout << "No timestamps on the graphics queue, the scene is rendered at full resolution" << std::endl;
+        }
+
+        VkQueryPoolCreateInfo poolInfo {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = 2;
+
+        for (FrameResources& frame : _frames)
+        {
+            if (vkCreateQueryPool(_device, &poolInfo, nullptr, &frame.timestampQueryPool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create timestamp query pool!");
+            }
+            frame.hasTimestamps = false;
+            frame.renderScale = DynamicResolution::MAX_SCALE;
+        }
+
+        if (!_hasPipelineStatistics)
+        {
+            std::cout << "No pipeline statistics queries, the overdraw is not measured" << std::endl;
+        }
+
+        for (FrameResources& frame : _frames)
+        {
+            frame.statisticsQueryPool = VK_NULL_HANDLE;
+            frame.hasStatistics = false;
+            if (!_hasPipelineStatistics)
+                continue;
+
+            VkQueryPoolCreateInfo statisticsPoolInfo {};
+            statisticsPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            statisticsPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            statisticsPoolInfo.queryCount = static_cast<uint32_t>(CULL_PASS_COUNT * frame.secondaryCommandPools.size());
+            statisticsPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+            if (vkCreateQueryPool(_device, &statisticsPoolInfo, nullptr, &frame.statisticsQueryPool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create pipeline statistics query pool!");
+            }
+        }
+    }
+
+    void Application::RecordCommandBuffer(const FrameResources& frame, uint32_t imageIndex)
+    {
+        VkCommandBuffer commandBuffer { frame.commandBuffer };
+
+        VkCommandBufferBeginInfo beginInfo {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         /*
-         * Possible levels
-         * VK_COMMAND_BUFFER_LEVEL_PRIMARY: Can be submitted to a queue for execution, but cannot be called from other command buffers.
-         * VK_COMMAND_BUFFER_LEVEL_SECONDARY: Cannot be submitted directly, but can be called from primary command buffers.
+         * Possible Flags 
+         * VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT: The command buffer will be rerecorded right after executing it once.
+         * VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT: This is a secondary command buffer that will be entirely within a single render pass.
+         * VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT: The command buffer can be resubmitted while it is also already pending execution.
          */
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = (uint32_t) _commandBuffers.size();
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        beginInfo.pInheritanceInfo = nullptr; // Optional
 
-        if (vkAllocateCommandBuffers(_device, &allocInfo, _commandBuffers.data()) != VK_SUCCESS)
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
         {
-            throw std::runtime_error("Failed to allocate command buffers!");
+            throw std::runtime_error("Failed to begin recording command buffer!");
         }
 
-        for (size_t i = 0; i < _commandBuffers.size(); i++)
+        // The passes and the barriers between them, see CreateRenderGraph
+        if (_hasGpuTimestamps)
         {
-            VkCommandBufferBeginInfo beginInfo {};
-            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            /*
-             * Possible Flags 
-             * VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT: The command buffer will be rerecorded right after executing it once.
-             * VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT: This is a secondary command buffer that will be entirely within a single render pass.
-             * VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT: The command buffer can be resubmitted while it is also already pending execution.
-             */
-            beginInfo.flags = 0; // Optional
-            beginInfo.pInheritanceInfo = nullptr; // Optional
+            vkCmdResetQueryPool(commandBuffer, frame.timestampQueryPool, 0, 2);
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.timestampQueryPool, 0);
+        }
+
+        // Outside the render passes, the draw tasks each begin and end one of them
+        if (_hasPipelineStatistics)
+        {
+            vkCmdResetQueryPool(commandBuffer, frame.statisticsQueryPool, 0,
+                static_cast<uint32_t>(CULL_PASS_COUNT * frame.secondaryCommandPools.size()));
+        }
+
+        _recordingFrame = &frame;
+        _renderGraph->SetImage(_graphResources.swapChainImage, _swapChainImages[imageIndex]);
+        _renderGraph->Execute(commandBuffer);
+        _recordingFrame = nullptr;
+
+        if (_hasGpuTimestamps)
+        {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.timestampQueryPool, 1);
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+    }
+
+    void Application::RecordDrawPass(VkCommandBuffer commandBuffer, const FrameResources& frame, CullPass pass)
+    {
+        // Clear Values MUST be identical to the order of attachments in FrameBuffer
+        std::array<VkClearValue, 2> clearValues {};
+        clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+        clearValues[1].depthStencil = { 1.0f, 0 };
+
+        // The late pass loads what the early pass drew, its clear values are ignored
+        VkRenderPassBeginInfo renderPassInfo {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = pass == CULL_PASS_EARLY ? _renderPass : _loadRenderPass;
+        renderPassInfo.framebuffer = _sceneFramebuffer;
+        renderPassInfo.renderArea.offset = {0, 0};
+        // Only the part at the render scale is cleared and drawn
+        renderPassInfo.renderArea.extent = _renderExtent;
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+
+
+        /*
+         * The final parameter controls how the drawing commands within the render pass will be provided.
+         * It can have one of two values:
+         * VK_SUBPASS_CONTENTS_INLINE:  The render pass commands will be embedded in the primary 
+         *                              command buffer itself and no secondary command buffers will be executed.
+         * VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: The render pass commands will be executed 
+         *                                                from secondary command buffers.
+         */
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        // Contiguous chunks of the sorted render queue, each recorded into its own secondary command buffers
+        size_t poolCount { frame.secondaryCommandPools.size() };
+        auto getSecondaryCommandBuffers = [&](DrawStage stage)
+        {
+            return frame.secondaryCommandBuffers.data() + (pass * DRAW_STAGE_COUNT + stage) * poolCount;
+        };
+        const VkCommandBuffer* depthPrePassCommandBuffers { getSecondaryCommandBuffers(DRAW_STAGE_DEPTH_PRE_PASS) };
+        const VkCommandBuffer* mainCommandBuffers { getSecondaryCommandBuffers(DRAW_STAGE_MAIN) };
+        bool useDepthPrePass { frame.usedDepthPrePass[pass] };
 
-            if (vkBeginCommandBuffer(_commandBuffers[i], &beginInfo) != VK_SUCCESS)
+        size_t taskCount { std::min(
+            poolCount,
+            (_renderQueue.GetSize() + MIN_DRAWS_PER_RECORDING_TASK - 1) / MIN_DRAWS_PER_RECORDING_TASK) };
+
+        if (taskCount > 0)
+        {
+            size_t drawsPerTask { (_renderQueue.GetSize() + taskCount - 1) / taskCount };
+            VkFramebuffer framebuffer { _sceneFramebuffer };
+
+            std::vector<std::future<void>> recordings;
+            recordings.reserve(taskCount);
+            for (size_t task = 0; task < taskCount; ++task)
             {
-                throw std::runtime_error("Failed to begin recording command buffer!");
+                size_t firstDraw { task * drawsPerTask };
+                size_t lastDraw { std::min(firstDraw + drawsPerTask, _renderQueue.GetSize()) };
+
+                recordings.push_back(_recordingThreadPool.Submit([&, task, firstDraw, lastDraw]()
+                {
+                    if (useDepthPrePass)
+                        RecordDraws(depthPrePassCommandBuffers[task], framebuffer, frame, pass, DRAW_STAGE_DEPTH_PRE_PASS, static_cast<uint32_t>(task), firstDraw, lastDraw);
+                    RecordDraws(mainCommandBuffers[task], framebuffer, frame, pass, DRAW_STAGE_MAIN, static_cast<uint32_t>(task), firstDraw, lastDraw);
+                }));
             }
 
-            // Clear Values MUST be identical to the order of attachments in FrameBuffer
-            std::array<VkClearValue, 2> clearValues {};
-            clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-            clearValues[1].depthStencil = { 1.0f, 0 };
+            // All the tasks reference this frame, none may still be running if one of them threw
+            for (std::future<void>& recording : recordings)
+            {
+                recording.wait();
+            }
+            for (std::future<void>& recording : recordings)
+            {
+                recording.get();
+            }
 
-            VkRenderPassBeginInfo renderPassInfo {};
-            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-            renderPassInfo.renderPass = _renderPass;
-            renderPassInfo.framebuffer = _swapChainFramebuffers[i];
-            renderPassInfo.renderArea.offset = {0, 0};
-            renderPassInfo.renderArea.extent = _swapChainExtent;
-            renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-            renderPassInfo.pClearValues = clearValues.data();
+            // In task order, the draws are executed in key order.
+            // The whole depth pre-pass comes first, so no fragment is shaded before the nearest depth is known.
+            if (useDepthPrePass)
+                vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(taskCount), depthPrePassCommandBuffers);
+            vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(taskCount), mainCommandBuffers);
+        }
 
+        vkCmdEndRenderPass(commandBuffer);
+    }
 
-            /*
-             * The final parameter controls how the drawing commands within the render pass will be provided.
-             * It can have one of two values:
-             * VK_SUBPASS_CONTENTS_INLINE:  The render pass commands will be embedded in the primary 
-             *                              command buffer itself and no secondary command buffers will be executed.
-             * VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: The render pass commands will be executed 
-             *                                                from secondary command buffers.
-             */
-            vkCmdBeginRenderPass(_commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    void Application::RecordCommandReset(VkCommandBuffer commandBuffer, const FrameResources& frame)
+    {
+        // One command per batch, with no instance yet : the culling pass counts them.
+        // At most 64 batches of 20 bytes, well under the 65536 bytes vkCmdUpdateBuffer accepts.
+        // Each pass has its own commands, and its own half of the visible instance list.
+        for (uint32_t pass = 0; pass < CULL_PASS_COUNT; ++pass)
+        {
+            std::vector<VkDrawIndexedIndirectCommand> commands;
+            commands.reserve(_drawBatches.size());
+            for (const DrawBatch& batch : _drawBatches)
+            {
+                VkDrawIndexedIndirectCommand command { batch.command };
+                command.firstInstance += pass * MAX_INSTANCES;
+                commands.push_back(command);
+            }
+
+            if (!commands.empty())
+            {
+                vkCmdUpdateBuffer(commandBuffer, frame.drawCommandBuffer,
+                    pass * MAX_DRAW_BATCHES * sizeof(VkDrawIndexedIndirectCommand),
+                    commands.size() * sizeof(VkDrawIndexedIndirectCommand), commands.data());
+            }
+        }
+    }
+
+    void Application::RecordCulling(VkCommandBuffer commandBuffer, const FrameResources& frame, CullPass pass)
+    {
+        CullPushConstants cull {};
+        Frustum frustum { Frustum::FromMatrix(_projection * _view) };
+        std::copy(frustum.planes.begin(), frustum.planes.end(), cull.frustumPlanes);
+        cull.instanceCount = static_cast<uint32_t>(_visibleObjects.size());
+        cull.pass = pass;
+        cull.commandOffset = pass * MAX_DRAW_BATCHES;
+
+        std::array<VkDescriptorSet, 2> descriptorSets { frame.cullDescriptorSet, _depthPyramid.cullDescriptorSet };
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipelineLayout,
+            0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr);
+        vkCmdPushConstants(commandBuffer, _cullPipelineLayout, _cullReflection.GetPushConstantStages(), 0, sizeof(cull), &cull);
+        vkCmdDispatch(commandBuffer, (cull.instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+    }
+
+    void Application::RecordDepthPyramid(VkCommandBuffer commandBuffer)
+    {
+        // The graph transitioned the depth for sampling, and hands it back to the late pass
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _depthReducePipeline);
+
+        // Each level reads the one written before it, within the pass
+        VkMemoryBarrier levelBarrier {};
+        levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        for (size_t level = 0; level < _depthPyramid.reduceDescriptorSets.size(); ++level)
+        {
+            uint32_t levelWidth { std::max(_depthPyramid.width >> level, 1u) };
+            uint32_t levelHeight { std::max(_depthPyramid.height >> level, 1u) };
+
+            if (level > 0)
+            {
+                vkCmdPipelineBarrier(commandBuffer,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                    1, &levelBarrier, 0, nullptr, 0, nullptr);
+            }
 
-            vkCmdBindPipeline(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
+            // Level 0 only reduces the part of the depth drawn at the render scale
+            DepthReducePushConstants reduce {};
+            if (level == 0)
+                reduce.inputSize = { _renderExtent.width, _renderExtent.height };
+            else
+                reduce.inputSize = { std::max(_depthPyramid.width >> (level - 1), 1u), std::max(_depthPyramid.height >> (level - 1), 1u) };
+
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _depthReducePipelineLayout,
+                0, 1, &_depthPyramid.reduceDescriptorSets[level], 0, nullptr);
+            vkCmdPushConstants(commandBuffer, _depthReducePipelineLayout, _depthReduceReflection.GetPushConstantStages(),
+                0, sizeof(reduce), &reduce);
+            vkCmdDispatch(commandBuffer,
+                (levelWidth + DEPTH_REDUCE_GROUP_SIZE - 1) / DEPTH_REDUCE_GROUP_SIZE,
+                (levelHeight + DEPTH_REDUCE_GROUP_SIZE - 1) / DEPTH_REDUCE_GROUP_SIZE,
+                1);
+        }
+    }
+
+    void Application::RecordUpscale(VkCommandBuffer commandBuffer, VkImage swapChainImage)
+    {
+        // Plain copy at full scale, the filter only matters below it
+        VkImageBlit blit {};
+        blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        blit.srcOffsets[1] = { static_cast<int32_t>(_renderExtent.width), static_cast<int32_t>(_renderExtent.height), 1 };
+        blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        blit.dstOffsets[1] = { static_cast<int32_t>(_swapChainExtent.width), static_cast<int32_t>(_swapChainExtent.height), 1 };
+
+        vkCmdBlitImage(commandBuffer,
+            _renderGraph->GetImage(_graphResources.sceneColor), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            swapChainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &blit, _upscaleFilter);
+    }
+
+    void Application::RecordDraws(
+        VkCommandBuffer commandBuffer,
+        VkFramebuffer framebuffer,
+        const FrameResources& frame,
+        CullPass pass,
+        DrawStage stage,
+        uint32_t task,
+        size_t firstDraw,
+        size_t lastDraw)
+    {
+        // Executed inside the render pass of the primary command buffer
+        VkCommandBufferInheritanceInfo inheritanceInfo {};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = pass == CULL_PASS_EARLY ? _renderPass : _loadRenderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = framebuffer; // Optional, may help the driver
+
+        VkCommandBufferBeginInfo beginInfo {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to begin recording command buffer!");
+        }
+
+        // Dynamic states are not inherited from the primary command buffer
+        VkViewport viewport {};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float) _renderExtent.width;
+        viewport.height = (float) _renderExtent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor {};
+        scissor.offset = {0, 0};
+        scissor.extent = _renderExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        // The pre-pass shades nothing, only the main draws are measured
+        bool isMeasured { stage == DRAW_STAGE_MAIN && _hasPipelineStatistics };
+        uint32_t statisticsQuery { static_cast<uint32_t>(pass * frame.secondaryCommandPools.size() + task) };
+        if (isMeasured)
+        {
+            vkCmdBeginQuery(commandBuffer, frame.statisticsQueryPool, statisticsQuery, 0);
+        }
+
+        // Opaque batches are drawn in the pre-pass when it runs, then shaded with an equal depth test
+        auto getPipeline = [&](const RenderCommand& command)
+        {
+            if (stage == DRAW_STAGE_DEPTH_PRE_PASS)
+                return command.depthPrePassPipeline;
+            if (frame.usedDepthPrePass[pass] && command.depthEqualPipeline != VK_NULL_HANDLE)
+                return command.depthEqualPipeline;
+            return command.pipeline;
+        };
+
+        // Nothing is bound at the start of a command buffer, then only what differs from the previous draw
+        VkPipeline boundPipeline { VK_NULL_HANDLE };
+        VkDescriptorSet boundDescriptorSet { VK_NULL_HANDLE };
+        VkBuffer boundVertexBuffer { VK_NULL_HANDLE };
+        VkBuffer boundIndexBuffer { VK_NULL_HANDLE };
+
+        for (size_t i = firstDraw; i < lastDraw;)
+        {
+            const RenderCommand& command { _renderQueue.GetCommand(i) };
+            VkPipeline pipeline { getPipeline(command) };
+
+            // Not compiled yet, or not part of the pre-pass : skipped
+            if (pipeline == VK_NULL_HANDLE)
+            {
+                ++i;
+                continue;
+            }
 
-            // Bind the vertices
-            VkBuffer vertexBuffers[] { _vertexBuffer };
-            VkDeviceSize offsets[] { 0 };
-            vkCmdBindVertexBuffers(_commandBuffers[i], 0, 1, vertexBuffers, offsets);
+            if (pipeline != boundPipeline)
+            {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+                boundPipeline = pipeline;
+            }
 
-            // Bind the indices
-            vkCmdBindIndexBuffer(_commandBuffers[i], _indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+            // All the pipelines share the layout, a bound set stays valid across pipeline changes
+            if (command.descriptorSet != boundDescriptorSet)
+            {
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &command.descriptorSet, 0, nullptr);
+                boundDescriptorSet = command.descriptorSet;
+            }
 
-            // OUTDATED (Only drawing w/ vertices)
-            // vkCmdDraw(_commandBuffers[i], static_cast<uint32_t>(vertices.size()), 1, 0, 0);
+            if (command.vertexBuffer != boundVertexBuffer)
+            {
+                VkBuffer vertexBuffers[] { command.vertexBuffer };
+                VkDeviceSize offsets[] { 0 };
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+                boundVertexBuffer = command.vertexBuffer;
+            }
 
-            // Bind the descriptor set to the command
-            vkCmdBindDescriptorSets(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &_descriptorSets[i], 0, nullptr);
+            if (command.indexBuffer != boundIndexBuffer)
+            {
+                vkCmdBindIndexBuffer(commandBuffer, command.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+                boundIndexBuffer = command.indexBuffer;
+            }
 
-            // Drawing using indices
-            vkCmdDrawIndexed(_commandBuffers[i], static_cast<uint32_t>(_indices.size()), 1, 0, 0, 0);
-            
-            vkCmdEndRenderPass(_commandBuffers[i]);
-            if (vkEndCommandBuffer(_commandBuffers[i]) != VK_SUCCESS)
+            // Following draws with the same state and the next commands are merged into one call
+            size_t lastMerged { i + 1 };
+            while (lastMerged < lastDraw)
             {
-                throw std::runtime_error("failed to record command buffer!");
+                const RenderCommand& next { _renderQueue.GetCommand(lastMerged) };
+                if (getPipeline(next) != pipeline
+                    || next.descriptorSet != command.descriptorSet
+                    || next.vertexBuffer != command.vertexBuffer
+                    || next.indexBuffer != command.indexBuffer
+                    || next.drawCommand != command.drawCommand + (lastMerged - i))
+                    break;
+
+                ++lastMerged;
             }
+
+            // The commands of the late pass follow the ones of the early pass
+            VkDeviceSize commandOffset { (pass * MAX_DRAW_BATCHES + command.drawCommand) * sizeof(VkDrawIndexedIndirectCommand) };
+            vkCmdDrawIndexedIndirect(commandBuffer,
+                frame.drawCommandBuffer, commandOffset,
+                static_cast<uint32_t>(lastMerged - i), sizeof(VkDrawIndexedIndirectCommand));
+
+            i = lastMerged;
+        }
+
+        if (isMeasured)
+        {
+            vkCmdEndQuery(commandBuffer, frame.statisticsQueryPool, statisticsQuery);
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to record command buffer!");
         }
     }
 
@@ -1740,103 +2876,203 @@ namespace Vulkan
     {
         _imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
         _renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        _inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-        _imagesInFlight.resize(_swapChainImages.size(), VK_NULL_HANDLE);
+        _imageTimelineValues.assign(_swapChainImages.size(), 0);
 
         VkSemaphoreCreateInfo semaphoreInfo {};
         semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-        VkFenceCreateInfo fenceInfo {};
-        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
         {
             if (vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_imageAvailableSemaphores[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_renderFinishedSemaphores[i]) != VK_SUCCESS ||
-                vkCreateFence    (_device, &fenceInfo, nullptr, &_inFlightFences[i]) != VK_SUCCESS)
+                vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_renderFinishedSemaphores[i]) != VK_SUCCESS)
             {
                 throw std::runtime_error("Failed to create semaphores!");
             }
         }
+
+        VkSemaphoreTypeCreateInfoKHR timelineInfo {};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+        timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+        timelineInfo.initialValue = 0;
+        semaphoreInfo.pNext = &timelineInfo;
+
+        if (vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_frameTimeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create semaphores!");
+        }
     }
 
-    void Application::RecreateSwapChain()
+    void Application::WaitForTimeline(uint64_t value)
     {
-        // Get the new size of the window
-        int width = 0, height = 0;
-        glfwGetFramebufferSize(_window, &width, &height);
+        VkSemaphoreWaitInfoKHR waitInfo {};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &_frameTimeline;
+        waitInfo.pValues = &value;
 
-        // Wait for the new size if it cannot be retreived yet
-        while (width == 0 || height == 0)
+        if (_vkWaitSemaphores(_device, &waitInfo, UINT64_MAX) != VK_SUCCESS)
         {
-            glfwGetFramebufferSize(_window, &width, &height);
-            glfwWaitEvents();
+            throw std::runtime_error("Failed to wait on the frame timeline!");
         }
+    }
 
-        vkDeviceWaitIdle(_device);
+    uint64_t Application::GetCompletedTimelineValue()
+    {
+        uint64_t value;
+        if (_vkGetSemaphoreCounterValue(_device, _frameTimeline, &value) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to read the frame timeline!");
+        }
+        return value;
+    }
 
-        CleanupSwapChain();
+    void Application::RecreateSwapChain()
+    {
+        // Get the new size of the window
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(_window, &width, &height);
+
+        // Wait for the new size if it cannot be retreived yet
+        while (width == 0 || height == 0)
+        {
+            glfwGetFramebufferSize(_window, &width, &height);
+            glfwWaitEvents();
+        }
+
+        // No device wait : the frames in flight keep using the old objects,
+        // which are retired and destroyed once those frames are done
+        VkFormat previousFormat { _swapChainImageFormat };
+        size_t previousImageCount { _swapChainImages.size() };
+
+        VkSwapchainKHR oldSwapChain { _swapChain };
+        std::vector<VkImageView> oldImageViews { _swapChainImageViews };
+        VkFramebuffer oldSceneFramebuffer { _sceneFramebuffer };
+        VkImageView oldSceneColorImageView { _sceneColorImageView };
+        VkImageView oldDepthImageView { _depthImageView };
+        DepthPyramid oldDepthPyramid { _depthPyramid };
+        // Shared, the copies of the destroy function all hold it
+        std::shared_ptr<RenderGraph> oldRenderGraph { std::move(_renderGraph) };
 
+        // oldSwapchain is set from _swapChain
         CreateSwapChain();
         CreateImageViews();
-        CreateRenderPass();
-        CreateGraphicsPipeline();
 
+        DeferDestroy([=]()
+        {
+            DestroyDepthPyramid(oldDepthPyramid);
+
+            vkDestroyImageView(_device, oldDepthImageView, nullptr);
+            // The depth and the depth pyramid images, with their memory
+            oldRenderGraph->Destroy();
+
+            vkDestroyFramebuffer(_device, oldSceneFramebuffer, nullptr);
+            vkDestroyImageView(_device, oldSceneColorImageView, nullptr);
+
+            for (VkImageView imageView : oldImageViews)
+            {
+                vkDestroyImageView(_device, imageView, nullptr);
+            }
+            vkDestroySwapchainKHR(_device, oldSwapChain, nullptr);
+        });
+
+        // The render pass (and the pipelines built against it) only depends on the surface format
+        if (_swapChainImageFormat != previousFormat)
+        {
+            VkRenderPass oldRenderPass { _renderPass };
+            VkRenderPass oldLoadRenderPass { _loadRenderPass };
+
+            // The pipelines are created again on first use, against the new render pass
+            DestroyPipelines(_pipelineStateCache->Clear(), true);
+            DeferDestroy([=]()
+            {
+                vkDestroyRenderPass(_device, oldRenderPass, nullptr);
+                vkDestroyRenderPass(_device, oldLoadRenderPass, nullptr);
+            });
+
+            CreateRenderPass();
+        }
+
+        // The transient images are sized for the new extent
+        CreateRenderGraph();
         CreateDepthResources();
+        // Its descriptor sets reference the depth image, they are created along with it
+        CreateDepthPyramid();
         CreateFramebuffers();
-        CreateUniformBuffer();
-        CreateDescriptorPool();
-        CreateDescriptorSets();
-        CreateCommandBuffers();        
+
+        // The frame resources do not depend on the swap chain, only the image timeline values do
+        if (_swapChainImages.size() != previousImageCount)
+        {
+            // New images, nothing to wait on for them
+            _imageTimelineValues.assign(_swapChainImages.size(), 0);
+        }
     }
 
-    void Application::CleanupSwapChain()
+    void Application::DeferDestroy(std::function<void()> destroy)
     {
-        vkDestroyImageView(_device, _depthImageView, nullptr);
-        vkDestroyImage(_device, _depthImage, nullptr);
-        vkFreeMemory(_device, _depthImageMemory, nullptr);
+        // Every frame submitted so far, and the one being recorded, may reference the objects
+        _deferredDestroys.push_back({ _frameNumber + 1, std::move(destroy) });
+    }
+
+    void Application::FlushDeferredDestroys(bool isDeviceIdle)
+    {
+        uint64_t completedValue { isDeviceIdle ? _frameNumber : GetCompletedTimelineValue() };
 
-        for (size_t i = 0; i < _swapChainFramebuffers.size(); ++i)
+        // Queued in submission order, so the values only grow
+        while (!_deferredDestroys.empty()
+            && (isDeviceIdle || _deferredDestroys.front().timelineValue <= completedValue))
         {
-            vkDestroyFramebuffer(_device, _swapChainFramebuffers[i], nullptr);
+            _deferredDestroys.front().destroy();
+            _deferredDestroys.pop_front();
         }
+    }
 
-        vkFreeCommandBuffers(_device, _commandPool, static_cast<uint32_t>(_commandBuffers.size()), _commandBuffers.data());
+    void Application::CleanupSwapChain()
+    {
+        DestroyDepthPyramid(_depthPyramid);
 
-        vkDestroyPipeline(_device, _graphicsPipeline, nullptr);
-        vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
-        vkDestroyRenderPass(_device, _renderPass, nullptr);
+        vkDestroyImageView(_device, _depthImageView, nullptr);
+        _renderGraph->Destroy();
+
+        vkDestroyFramebuffer(_device, _sceneFramebuffer, nullptr);
+        vkDestroyImageView(_device, _sceneColorImageView, nullptr);
 
         for (size_t i = 0; i < _swapChainImageViews.size(); ++i) 
         {
             vkDestroyImageView(_device, _swapChainImageViews[i], nullptr);
         }
         vkDestroySwapchainKHR(_device, _swapChain, nullptr);
+    }
 
-        for (size_t i = 0; i < _swapChainImages.size(); ++i)
+    void Application::CleanupFrameResources()
+    {
+        for (FrameResources& frame : _frames)
         {
-            vkDestroyBuffer(_device, _uniformBuffers[i], nullptr);
-            vkFreeMemory(_device, _uniformBuffersMemory[i], nullptr);
-        }
+            // Frees the command buffers along with the pools
+            vkDestroyCommandPool(_device, frame.commandPool, nullptr);
+            for (VkCommandPool secondaryCommandPool : frame.secondaryCommandPools)
+            {
+                vkDestroyCommandPool(_device, secondaryCommandPool, nullptr);
+            }
 
-        vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
-    }
-    
-    VkShaderModule Application::CreateShaderModule(const std::vector<char>& code)
-    {
-        VkShaderModuleCreateInfo createInfo {};
-        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+            vkUnmapMemory(_device, frame.uniformBufferMemory);
+            vkDestroyBuffer(_device, frame.uniformBuffer, nullptr);
+            vkFreeMemory(_device, frame.uniformBufferMemory, nullptr);
 
-        VkShaderModule shaderModule;
-        if (vkCreateShaderModule(_device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to create shader module!");
+            vkUnmapMemory(_device, frame.instanceBufferMemory);
+            vkDestroyBuffer(_device, frame.instanceBuffer, nullptr);
+            vkFreeMemory(_device, frame.instanceBufferMemory, nullptr);
+
+            vkDestroyBuffer(_device, frame.drawCommandBuffer, nullptr);
+            vkFreeMemory(_device, frame.drawCommandBufferMemory, nullptr);
+
+            vkDestroyBuffer(_device, frame.visibleInstanceBuffer, nullptr);
+            vkFreeMemory(_device, frame.visibleInstanceBufferMemory, nullptr);
+
+            vkDestroyQueryPool(_device, frame.timestampQueryPool, nullptr);
+            vkDestroyQueryPool(_device, frame.statisticsQueryPool, nullptr);
         }
 
-        return shaderModule;
+        vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
     }
     
     VkBool32 Application::DebugCallback(
@@ -1877,21 +3113,196 @@ namespace Vulkan
         app->IsFramebufferResized() = true;
     }
 
+    void Application::KeyCallback(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/)
+    {
+        if (action != GLFW_PRESS)
+            return;
+
+        Application* app { reinterpret_cast<Application*>(glfwGetWindowUserPointer(window)) };
+
+        switch (key)
+        {
+            case GLFW_KEY_F1: app->RequestPresentPolicy(PRESENT_POLICY_LOW_LATENCY); break;
+            case GLFW_KEY_F2: app->RequestPresentPolicy(PRESENT_POLICY_THROUGHPUT);  break;
+            case GLFW_KEY_F3: app->RequestPresentPolicy(PRESENT_POLICY_VSYNC);       break;
+            case GLFW_KEY_F5: app->ToggleDepthPrePass(CULL_PASS_EARLY);              break;
+            case GLFW_KEY_F6: app->ToggleDepthPrePass(CULL_PASS_LATE);               break;
+            default: break;
+        }
+    }
+
 
     void Application::MainLoop()
     {
+        auto lastShaderPoll { std::chrono::high_resolution_clock::now() };
+        auto lastStatsReport { lastShaderPoll };
+
+        PrintPresentPolicy();
+
+        StartSimulation();
+
         while (!glfwWindowShouldClose(_window))
         {
             glfwPollEvents();
+
+            if (_requestedPresentPolicy != _presentPolicy)
+            {
+                ApplyPresentPolicy(_requestedPresentPolicy);
+            }
+
+            auto currentTime { std::chrono::high_resolution_clock::now() };
+            if (std::chrono::duration<float, std::chrono::seconds::period>(currentTime - lastShaderPoll).count() > SHADER_RELOAD_INTERVAL)
+            {
+                ReloadChangedShaders();
+                lastShaderPoll = currentTime;
+            }
+
+            if (std::chrono::duration<float, std::chrono::seconds::period>(currentTime - lastStatsReport).count() > FRAME_STATS_INTERVAL)
+            {
+                _frameStats.ReportInterval(std::cout);
+                PrintDynamicResolution();
+                PrintOverdraw();
+                lastStatsReport = currentTime;
+            }
+
             DrawFrame();
         }
 
+        StopSimulation();
         vkDeviceWaitIdle(_device);
+
+        _frameStats.CompleteFrames(_frameNumber);
+        std::cout << "Frame stats since startup:" << std::endl;
+        _frameStats.ReportTotals(std::cout);
+    }
+
+    void Application::ApplyPresentPolicy(PresentPolicy policy)
+    {
+        // The frame slots are numbered again from 0 : no submitted frame may still use one
+        WaitForTimeline(_frameNumber);
+        _frameStats.CompleteFrames(_frameNumber);
+
+        _presentPolicy = policy;
+        _requestedPresentPolicy = policy;
+        _framesInFlight = GetPresentPolicySettings(policy).framesInFlight;
+        _currentFrame = 0;
+
+        // New present mode and image count
+        RecreateSwapChain();
+
+        PrintPresentPolicy();
+    }
+
+    void Application::PrintPresentPolicy()
+    {
+        std::cout << "Present policy " << GetPresentPolicySettings(_presentPolicy).name << ": "
+            << GetPresentModeName(_swapChainPresentMode) << ", " << _framesInFlight << " frames in flight, "
+            << _swapChainImages.size() << " swap chain images" << std::endl;
+    }
+
+    void Application::PrintDynamicResolution()
+    {
+        if (!_hasGpuTimestamps)
+            return;
+
+        VkExtent2D renderExtent { _dynamicResolution.GetRenderExtent(_swapChainExtent) };
+        std::cout << std::fixed << std::setprecision(2)
+            << "Dynamic resolution: scale " << _dynamicResolution.GetScale()
+            << " (" << renderExtent.width << "x" << renderExtent.height << "), GPU "
+            << _dynamicResolution.GetSmoothedTime() * 1000.0 << " ms of "
+            << _dynamicResolution.GetFrameBudget() * 1000.0 << " ms" << std::endl;
+        std::cout << std::defaultfloat;
+    }
+
+    void Application::ReadFrameTime(FrameResources& frame)
+    {
+        if (!frame.hasTimestamps)
+            return;
+        frame.hasTimestamps = false;
+
+        // The frame has completed, the results are available without waiting
+        std::array<uint64_t, 2> timestamps;
+        if (vkGetQueryPoolResults(_device, frame.timestampQueryPool, 0, 2, sizeof(timestamps), timestamps.data(),
+            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        {
+            return;
+        }
+
+        uint64_t ticks { (timestamps[1] - timestamps[0]) & _timestampMask };
+        _dynamicResolution.AddFrameTime(ticks * _timestampPeriod * 1e-9, frame.renderScale);
+    }
+
+    void Application::ReadOverdraw(FrameResources& frame)
+    {
+        if (!frame.hasStatistics)
+            return;
+        frame.hasStatistics = false;
+
+        // Value then availability of each query : the tasks not run this frame left theirs unavailable
+        size_t poolCount { frame.secondaryCommandPools.size() };
+        std::vector<uint64_t> results(CULL_PASS_COUNT * poolCount * 2);
+        VkResult result { vkGetQueryPoolResults(_device, frame.statisticsQueryPool, 0, static_cast<uint32_t>(CULL_PASS_COUNT * poolCount),
+            results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT) };
+
+        if (result != VK_SUCCESS && result != VK_NOT_READY)
+            return;
+
+        for (size_t pass = 0; pass < CULL_PASS_COUNT; ++pass)
+        {
+            uint64_t fragmentCount { 0 };
+            for (size_t task = 0; task < poolCount; ++task)
+            {
+                size_t query { pass * poolCount + task };
+                if (results[query * 2 + 1] != 0)
+                    fragmentCount += results[query * 2];
+            }
+
+            OverdrawTotals& totals { _overdrawTotals[pass][frame.usedDepthPrePass[pass] ? 1 : 0] };
+            totals.fragmentCount += fragmentCount;
+            totals.pixelCount += frame.renderedPixels;
+        }
+    }
+
+    void Application::PrintOverdraw()
+    {
+        if (!_hasPipelineStatistics)
+            return;
+
+        const char* passNames[CULL_PASS_COUNT] { "early", "late" };
+        std::cout << std::fixed << std::setprecision(2);
+        for (size_t pass = 0; pass < CULL_PASS_COUNT; ++pass)
+        {
+            for (size_t withPrePass = 0; withPrePass < 2; ++withPrePass)
+            {
+                const OverdrawTotals& totals { _overdrawTotals[pass][withPrePass] };
+                if (totals.pixelCount == 0)
+                    continue;
+
+                std::cout << "Overdraw of the " << passNames[pass] << " pass, "
+                    << (withPrePass ? "with" : "without") << " depth pre-pass: "
+                    << totals.fragmentCount / static_cast<double>(totals.pixelCount) << " fragments shaded per pixel" << std::endl;
+            }
+        }
+        std::cout << std::defaultfloat;
+
+        _overdrawTotals = {};
+    }
+
+    void Application::ToggleDepthPrePass(CullPass pass)
+    {
+        _isDepthPrePassEnabled[pass] = !_isDepthPrePassEnabled[pass];
+        std::cout << "Depth pre-pass of the " << (pass == CULL_PASS_EARLY ? "early" : "late") << " pass: "
+            << (_isDepthPrePassEnabled[pass] ? "on" : "off") << std::endl;
     }
 
     void Application::DrawFrame()
     {
-        vkWaitForFences(_device, 1, &_inFlightFences[_currentFrame], VK_TRUE, UINT64_MAX);
+        // The frame that last used these per frame resources has signaled this value
+        uint64_t reuseValue { _frameNumber >= _framesInFlight ? _frameNumber + 1 - _framesInFlight : 0 };
+        WaitForTimeline(reuseValue);
+
+        FlushDeferredDestroys(false);
 
         uint32_t imageIndex;
         VkResult result { vkAcquireNextImageKHR(_device, _swapChain, UINT64_MAX, _imageAvailableSemaphores[_currentFrame], VK_NULL_HANDLE, &imageIndex) };
@@ -1906,39 +3317,78 @@ namespace Vulkan
             throw std::runtime_error("Failed to acquire swap chain image!");
         }
 
-        // Check if a previous frame is using this image (i.e. there is its fence to wait on)
-        if (_imagesInFlight[imageIndex] != VK_NULL_HANDLE)
+        // Only a frame more recent than the one waited on above still needs waiting on
+        if (_imageTimelineValues[imageIndex] > reuseValue)
         {
-            vkWaitForFences(_device, 1, &_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+            WaitForTimeline(_imageTimelineValues[imageIndex]);
         }
 
         // Mark the image as now being in use by this frame
-        _imagesInFlight[imageIndex] = _inFlightFences[_currentFrame];
+        _imageTimelineValues[imageIndex] = _frameNumber + 1;
 
-        UpdateUniformBuffer(imageIndex);
+        // The waits are over, the CPU work of the frame starts here
+        _frameStats.CompleteFrames(GetCompletedTimelineValue());
+        _frameStats.BeginFrame(_frameNumber + 1, _presentPolicy);
+
+        // The timeline has been waited on above, nothing recorded in the pool of this frame is pending anymore.
+        // The command buffer is recorded fresh from the render list.
+        FrameResources& frame { _frames[_currentFrame] };
+        ReadFrameTime(frame);
+        ReadOverdraw(frame);
+        vkResetCommandPool(_device, frame.commandPool, 0);
+        for (VkCommandPool secondaryCommandPool : frame.secondaryCommandPools)
+        {
+            vkResetCommandPool(_device, secondaryCommandPool, 0);
+        }
+
+        _framePacket = &AcquireFramePacket();
+        UpdateCamera(*_framePacket);
+        UpdateInstanceBuffer(frame);
+        UpdateUniformBuffer(frame);
+
+        _renderExtent = _dynamicResolution.GetRenderExtent(_swapChainExtent);
+        frame.renderScale = _dynamicResolution.GetScale();
+        frame.usedDepthPrePass = _isDepthPrePassEnabled;
+        frame.renderedPixels = static_cast<uint64_t>(_renderExtent.width) * _renderExtent.height;
+        RecordCommandBuffer(frame, imageIndex);
+        frame.hasTimestamps = _hasGpuTimestamps;
+        frame.hasStatistics = _hasPipelineStatistics;
 
         VkSubmitInfo submitInfo {};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
         VkSemaphore waitSemaphores[] { _imageAvailableSemaphores[_currentFrame] };
-        VkPipelineStageFlags waitStages[] { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+        // The image is first written by the upscale, see CreateRenderGraph
+        VkPipelineStageFlags waitStages[] { VK_PIPELINE_STAGE_TRANSFER_BIT };
         submitInfo.waitSemaphoreCount = 1;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &_commandBuffers[imageIndex];
+        submitInfo.pCommandBuffers = &frame.commandBuffer;
 
-        VkSemaphore signalSemaphores[] = { _renderFinishedSemaphores[_currentFrame] };
-        submitInfo.signalSemaphoreCount = 1;
+        VkSemaphore signalSemaphores[] = { _renderFinishedSemaphores[_currentFrame], _frameTimeline };
+        submitInfo.signalSemaphoreCount = 2;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
-        vkResetFences(_device, 1, &_inFlightFences[_currentFrame]);
+        // Values of binary semaphores are ignored
+        uint64_t waitValues[] { 0 };
+        uint64_t signalValues[] { 0, _frameNumber + 1 };
 
-        if (vkQueueSubmit(_graphicsQueue, 1, &submitInfo, _inFlightFences[_currentFrame]) != VK_SUCCESS)
+        VkTimelineSemaphoreSubmitInfoKHR timelineInfo {};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+        timelineInfo.waitSemaphoreValueCount = 1;
+        timelineInfo.pWaitSemaphoreValues = waitValues;
+        timelineInfo.signalSemaphoreValueCount = 2;
+        timelineInfo.pSignalSemaphoreValues = signalValues;
+        submitInfo.pNext = &timelineInfo;
+
+        if (vkQueueSubmit(_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
         {
             throw std::runtime_error("failed to submit draw command buffer!");
         }
 
+        ++_frameNumber;
+
         VkPresentInfoKHR presentInfo {};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
@@ -1963,32 +3413,369 @@ namespace Vulkan
             throw std::runtime_error("Failed to acquire swap chain image!");
         }
 
-        _currentFrame = (_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        _currentFrame = (_currentFrame + 1) % _framesInFlight;
     }
 
-    void Application::UpdateUniformBuffer(uint32_t currentImage)
+    void Application::ReloadChangedShaders()
     {
-        static auto startTime { std::chrono::high_resolution_clock::now() };
+        std::vector<std::string> changedShaders { _shaderManager.PollChanges() };
+        if (changedShaders.empty())
+            return;
+
+        // Small enough to be rebuilt right away, frames in flight may still use the old ones
+        auto reloadComputePipeline = [&](const std::string& shaderPath, VkPipelineLayout layout, VkPipeline& pipeline)
+        {
+            if (std::find(changedShaders.begin(), changedShaders.end(), ShaderManager::MakeKey(shaderPath, {})) == changedShaders.end())
+                return;
 
-        auto currentTime { std::chrono::high_resolution_clock::now() };
-        float deltaTime { std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count() };
+            VkPipeline oldPipeline { pipeline };
+            DeferDestroy([=]()
+            {
+                vkDestroyPipeline(_device, oldPipeline, nullptr);
+            });
 
-        UniformBufferObject ubo {};
-        ubo.model = glm::rotate(glm::mat4(1.0f), deltaTime * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        ubo.projection = glm::perspective(glm::radians(45.0f), _swapChainExtent.width / (float) _swapChainExtent.height, 0.1f, 10.0f);
+            pipeline = CreateComputePipeline(shaderPath, layout);
+        };
 
-        ubo.projection[1][1] *= -1;
+        reloadComputePipeline(CULL_SHADER_PATH, _cullPipelineLayout, _cullPipeline);
+        reloadComputePipeline(DEPTH_REDUCE_SHADER_PATH, _depthReducePipelineLayout, _depthReducePipeline);
 
-        void* data;
-        vkMapMemory(_device, _uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0, &data);
-        memcpy(data, &ubo, sizeof(ubo));
-        vkUnmapMemory(_device, _uniformBuffersMemory[currentImage]);
+        // Only the pipelines built from one of the changed shaders are rebuilt, in the background :
+        // the draws using them are skipped until they are ready. Frames in flight may still use the old ones.
+        std::vector<std::shared_future<VkPipeline>> oldPipelines { _pipelineStateCache->Rebuild(changedShaders) };
+        DestroyPipelines(oldPipelines, true);
+    }
+
+    const FramePacket& Application::AcquireFramePacket()
+    {
+        if (_hasSimulationFailed.load(std::memory_order_acquire))
+        {
+            std::rethrow_exception(_simulationError);
+        }
+
+        // Nothing new since the last frame : the last packet is drawn again
+        if (_framePackets.Acquire() || _framePacket != nullptr)
+            return _framePackets.GetReadBuffer();
+
+        // Only the first frame has nothing to draw yet
+        {
+            std::unique_lock<std::mutex> lock { _simulationMutex };
+            _simulationCondition.wait(lock, [this]
+            {
+                return _hasFirstFramePacket || _hasSimulationFailed.load(std::memory_order_acquire);
+            });
+        }
+
+        if (_hasSimulationFailed.load(std::memory_order_acquire))
+        {
+            std::rethrow_exception(_simulationError);
+        }
+
+        _framePackets.Acquire();
+        return _framePackets.GetReadBuffer();
+    }
+
+    void Application::UpdateCamera(const FramePacket& packet)
+    {
+        _view = packet.view;
+        _projection = glm::perspective(packet.fieldOfView, _swapChainExtent.width / (float) _swapChainExtent.height, CAMERA_NEAR, CAMERA_FAR);
+
+        _projection[1][1] *= -1;
+    }
+
+    void Application::StartSimulation()
+    {
+        _isSimulationStopping = false;
+        _simulationThread = std::thread { &Application::SimulationLoop, this };
+    }
+
+    void Application::StopSimulation()
+    {
+        if (!_simulationThread.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock { _simulationMutex };
+            _isSimulationStopping = true;
+        }
+        _simulationCondition.notify_all();
+
+        _simulationThread.join();
+    }
+
+    void Application::SimulationLoop()
+    {
+        try
+        {
+            auto startTime { std::chrono::steady_clock::now() };
+            auto nextStepTime { startTime };
+            uint64_t simulationStep { 0 };
+
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock { _simulationMutex };
+                    if (_simulationCondition.wait_until(lock, nextStepTime, [this] { return _isSimulationStopping; }))
+                        break;
+                }
+
+                auto currentTime { std::chrono::steady_clock::now() };
+                float time { std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count() };
+
+                FramePacket& packet { _framePackets.GetWriteBuffer() };
+                packet.simulationStep = simulationStep++;
+                UpdateScene(time, packet);
+
+                _framePackets.Publish();
+
+                if (simulationStep == 1)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock { _simulationMutex };
+                        _hasFirstFramePacket = true;
+                    }
+                    _simulationCondition.notify_all();
+                }
+
+                // Paced from the schedule so a late wake-up does not delay the next steps,
+                // steps missed entirely (i.e. a debugger break) are dropped
+                nextStepTime = std::max(nextStepTime + SIMULATION_STEP, currentTime);
+            }
+        }
+        catch (...)
+        {
+            // Rethrown on the render thread by the next acquire
+            {
+                std::lock_guard<std::mutex> lock { _simulationMutex };
+                _simulationError = std::current_exception();
+                _hasSimulationFailed.store(true, std::memory_order_release);
+            }
+            _simulationCondition.notify_all();
+        }
+    }
+
+    void Application::UpdateScene(float time, FramePacket& packet)
+    {
+        packet.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        packet.fieldOfView = glm::radians(45.0f);
+
+        _transforms.SetRotation(_modelTransform, glm::angleAxis(time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+        _transforms.Update();
+
+        // Copied into a buffer of the same size most of the time, the allocations are reused
+        packet.drawList.assign(_renderList.begin(), _renderList.end());
+        packet.worldMatrices.resize(_renderList.size());
+        for (size_t i = 0; i < _renderList.size(); ++i)
+        {
+            packet.worldMatrices[i] = _transforms.GetWorldMatrix(_renderList[i].transform);
+        }
+    }
+
+    void Application::UpdateInstanceBuffer(FrameResources& frame)
+    {
+        const std::vector<RenderObject>& drawList { _framePacket->drawList };
+        const std::vector<glm::mat4>& worldMatrices { _framePacket->worldMatrices };
+
+        // World space bounds of every object, only the ones in the frustum reach the GPU
+        _frustumCuller.Resize(drawList.size());
+        for (size_t i = 0; i < drawList.size(); ++i)
+        {
+            const RenderObject& object { drawList[i] };
+            const glm::mat4& transform { worldMatrices[i] };
+
+            glm::vec3 center { transform * glm::vec4(glm::vec3(object.mesh.boundingSphere), 1.0f) };
+            // The largest axis scale keeps the sphere enclosing the mesh
+            float scale { std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) }) };
+            _frustumCuller.SetSphere(i, center, object.mesh.boundingSphere.w * scale);
+        }
+
+        _frustumCuller.Cull(Frustum::FromMatrix(_projection * _view), _recordingThreadPool, _visibleObjects);
+
+        if (_visibleObjects.size() > MAX_INSTANCES)
+        {
+            throw std::runtime_error("More than MAX_INSTANCES objects are visible!");
+        }
+
+        // Objects sharing a shader variant and a mesh are drawn by the same instanced draw
+        _drawBatches.clear();
+
+        std::vector<uint32_t> objectBatches(_visibleObjects.size());
+        // Normalized view depth of the nearest (x) and farthest (y) object of each batch
+        std::vector<glm::vec2> batchDepths;
+
+        for (size_t i = 0; i < _visibleObjects.size(); ++i)
+        {
+            const RenderObject& object { drawList[_visibleObjects[i]] };
+
+            auto batch { std::find_if(_drawBatches.begin(), _drawBatches.end(), [&](const DrawBatch& other)
+            {
+                return other.variant == object.variant
+                    && other.command.indexCount == object.mesh.indexCount
+                    && other.command.firstIndex == object.mesh.firstIndex
+                    && other.command.vertexOffset == object.mesh.vertexOffset;
+            }) };
+
+            if (batch == _drawBatches.end())
+            {
+                if (_drawBatches.size() == MAX_DRAW_BATCHES)
+                {
+                    throw std::runtime_error("Render list needs more than MAX_DRAW_BATCHES batches!");
+                }
+
+                DrawBatch newBatch {};
+                newBatch.variant = object.variant;
+                newBatch.meshId = object.mesh.id;
+                newBatch.command.indexCount = object.mesh.indexCount;
+                newBatch.command.instanceCount = 0;
+                newBatch.command.firstIndex = object.mesh.firstIndex;
+                newBatch.command.vertexOffset = object.mesh.vertexOffset;
+                _drawBatches.push_back(newBatch);
+                batchDepths.push_back(glm::vec2(1.0f, 0.0f));
+
+                batch = _drawBatches.end() - 1;
+            }
+
+            ++batch->objectCount;
+
+            size_t batchIndex { static_cast<size_t>(batch - _drawBatches.begin()) };
+            objectBatches[i] = static_cast<uint32_t>(batchIndex);
+
+            glm::vec4 viewCenter { _view * worldMatrices[_visibleObjects[i]] * glm::vec4(glm::vec3(object.mesh.boundingSphere), 1.0f) };
+            float depth { -viewCenter.z / CAMERA_FAR };
+            batchDepths[batchIndex].x = std::min(batchDepths[batchIndex].x, depth);
+            batchDepths[batchIndex].y = std::max(batchDepths[batchIndex].y, depth);
+        }
+
+        // Sorting decides where the command of each batch is stored
+        std::vector<uint32_t> batchSlots { BuildRenderQueue(frame, batchDepths) };
+
+        for (size_t i = 0; i < _visibleObjects.size(); ++i)
+        {
+            const RenderObject& object { drawList[_visibleObjects[i]] };
+
+            // Write-only, the mapped memory may be uncached
+            InstanceData instance {};
+            instance.model = worldMatrices[_visibleObjects[i]];
+            instance.boundingSphere = object.mesh.boundingSphere;
+            instance.objectId = object.objectId;
+            instance.batch = batchSlots[objectBatches[i]];
+            frame.instances[i] = instance;
+        }
+
+        // Each batch gets a range of the visible instance list large enough for all its objects
+        uint32_t firstInstance { 0 };
+        for (DrawBatch& batch : _drawBatches)
+        {
+            batch.command.firstInstance = firstInstance;
+            firstInstance += batch.objectCount;
+        }
+    }
+
+    std::vector<uint32_t> Application::BuildRenderQueue(const FrameResources& frame, const std::vector<glm::vec2>& batchDepths)
+    {
+        _renderQueue.Clear();
+
+        // Dense ids of the pipelines used this frame
+        std::vector<VkPipeline> pipelineIds;
+
+        for (size_t i = 0; i < _drawBatches.size(); ++i)
+        {
+            const DrawBatch& batch { _drawBatches[i] };
+            PipelineStateKey state { MakePipelineState(batch.variant) };
+
+            // The pipeline state cache is not thread safe, the pipelines are looked up before the recording is split.
+            // A pipeline still being compiled either stalls here or its draws are skipped this frame.
+            RenderCommand command {};
+            command.pipeline = _pipelineStateCache->Get(state, _isWaitingForPipelines);
+            command.descriptorSet = frame.descriptorSet;
+            command.vertexBuffer = _vertexBuffer;
+            command.indexBuffer = _indexBuffer;
+            command.drawCommand = static_cast<uint32_t>(i);
+
+            auto pipelineId { std::find(pipelineIds.begin(), pipelineIds.end(), command.pipeline) };
+            if (pipelineId == pipelineIds.end())
+            {
+                pipelineIds.push_back(command.pipeline);
+                pipelineId = pipelineIds.end() - 1;
+            }
+
+            RenderQueue::Pass pass { RenderQueue::PASS_OPAQUE };
+            if (state.blendMode != BLEND_MODE_OPAQUE)
+                pass = RenderQueue::PASS_TRANSPARENT;
+            else if (batch.variant.HasFeature(SHADER_FEATURE_ALPHA_TEST))
+                pass = RenderQueue::PASS_ALPHA_TESTED;
+
+            // Looked up whether the pre-pass runs or not, it may be toggled on any frame.
+            // Only all three pipelines together, a batch drawn in the pre-pass must also be shaded.
+            if (pass == RenderQueue::PASS_OPAQUE && command.pipeline != VK_NULL_HANDLE)
+            {
+                command.depthPrePassPipeline = _pipelineStateCache->Get(MakeDepthPrePassState(), _isWaitingForPipelines);
+                command.depthEqualPipeline = _pipelineStateCache->Get(MakeDepthEqualState(batch.variant), _isWaitingForPipelines);
+                if (command.depthPrePassPipeline == VK_NULL_HANDLE || command.depthEqualPipeline == VK_NULL_HANDLE)
+                {
+                    command.depthPrePassPipeline = VK_NULL_HANDLE;
+                    command.depthEqualPipeline = VK_NULL_HANDLE;
+                }
+            }
+
+            // Opaque batches front to back from their nearest object, transparent ones back to front from their farthest.
+            // A single material (descriptor set) for now
+            uint64_t key { RenderQueue::MakeKey(
+                pass,
+                static_cast<uint32_t>(pipelineId - pipelineIds.begin()),
+                0,
+                batch.meshId,
+                pass == RenderQueue::PASS_TRANSPARENT ? batchDepths[i].y : batchDepths[i].x) };
+
+            _renderQueue.Push(key, command);
+        }
+
+        _renderQueue.Sort();
+
+        // The commands are stored in key order, so consecutive draws sharing a state can be merged
+        std::vector<uint32_t> batchSlots(_drawBatches.size());
+        std::vector<DrawBatch> sortedBatches;
+        sortedBatches.reserve(_drawBatches.size());
+
+        for (size_t i = 0; i < _renderQueue.GetSize(); ++i)
+        {
+            RenderCommand& command { _renderQueue.GetCommand(i) };
+            batchSlots[command.drawCommand] = static_cast<uint32_t>(i);
+            sortedBatches.push_back(_drawBatches[command.drawCommand]);
+            command.drawCommand = static_cast<uint32_t>(i);
+        }
+
+        _drawBatches.swap(sortedBatches);
+        return batchSlots;
+    }
+
+    void Application::UpdateUniformBuffer(FrameResources& frame)
+    {
+        UniformBufferObject ubo {};
+        ubo.view = _view;
+        ubo.projection = _projection;
+
+        memcpy(frame.uniformBufferMapped, &ubo, sizeof(ubo));
     }
     
     void Application::Cleanup()
     {
+        FlushDeferredDestroys(true);
+
         CleanupSwapChain();
+        CleanupFrameResources();
+
+        DestroyPipelines(_pipelineStateCache->Clear(), false);
+        vkDestroyPipeline(_device, _cullPipeline, nullptr);
+        vkDestroyPipeline(_device, _depthReducePipeline, nullptr);
+        _layoutCache->Destroy();
+        vkDestroyRenderPass(_device, _renderPass, nullptr);
+        vkDestroyRenderPass(_device, _loadRenderPass, nullptr);
+
+        vkDestroySampler(_device, _depthPyramidSampler, nullptr);
+
+        vkDestroyBuffer(_device, _visibilityBuffer, nullptr);
+        vkFreeMemory(_device, _visibilityBufferMemory, nullptr);
 
         vkDestroySampler(_device, _textureSampler, nullptr);
         vkDestroyImageView(_device, _textureImageView, nullptr);
@@ -1996,8 +3783,6 @@ namespace Vulkan
         vkDestroyImage(_device, _textureImage, nullptr);
         vkFreeMemory(_device, _textureImageMemory, nullptr);
 
-        vkDestroyDescriptorSetLayout(_device, _descriptorSetLayout, nullptr);
-
         vkDestroyBuffer(_device, _indexBuffer, nullptr);
         vkFreeMemory(_device, _indexBufferMemory, nullptr);
         
@@ -2008,10 +3793,13 @@ namespace Vulkan
         {
             vkDestroySemaphore(_device, _renderFinishedSemaphores[i], nullptr);
             vkDestroySemaphore(_device, _imageAvailableSemaphores[i], nullptr);
-            vkDestroyFence(_device, _inFlightFences[i], nullptr);
         }
+        vkDestroySemaphore(_device, _frameTimeline, nullptr);
         
         vkDestroyCommandPool(_device, _commandPool, nullptr);
+
+        SavePipelineCache();
+        vkDestroyPipelineCache(_device, _pipelineCache, nullptr);
         
         vkDestroyDevice(_device, nullptr);
 
@@ -0,0 +1,66 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Vulkan
+{
+    DynamicResolution::DynamicResolution(double frameBudget)
+        : _frameBudget { frameBudget }
+    {
+    }
+
+    void DynamicResolution::AddFrameTime(double gpuTime, float renderScale)
+    {
+        // The frames in flight may have been rendered at a previous scale, brought to the current one
+        double areaRatio { (_scale / renderScale) * (_scale / renderScale) };
+        double time { gpuTime * areaRatio };
+
+        if (_smoothedTime == 0.0)
+        {
+            _smoothedTime = time;
+        }
+        else
+        {
+            double weight { time > _smoothedTime ? RISE_SMOOTHING : FALL_SMOOTHING };
+            _smoothedTime += (time - _smoothedTime) * weight;
+        }
+
+        float scale { _scale };
+        double targetTime { _frameBudget * TARGET_RATIO };
+
+        if (_smoothedTime > _frameBudget * DOWNSCALE_RATIO)
+        {
+            scale = static_cast<float>(_scale * std::sqrt(targetTime / _smoothedTime));
+            _framesUnderBudget = 0;
+        }
+        else if (_smoothedTime < _frameBudget * UPSCALE_RATIO)
+        {
+            if (++_framesUnderBudget >= UPSCALE_DELAY)
+            {
+                scale = std::min(static_cast<float>(_scale * std::sqrt(targetTime / _smoothedTime)), _scale + MAX_UPSCALE_STEP);
+                _framesUnderBudget = 0;
+            }
+        }
+        else
+        {
+            _framesUnderBudget = 0;
+        }
+
+        scale = std::clamp(scale, MIN_SCALE, MAX_SCALE);
+        if (scale != _scale)
+        {
+            // Expected time at the new scale, until frames rendered at it are measured
+            _smoothedTime *= (scale / _scale) * (scale / _scale);
+            _scale = scale;
+        }
+    }
+
+    VkExtent2D DynamicResolution::GetRenderExtent(VkExtent2D extent) const
+    {
+        return {
+            std::max(static_cast<uint32_t>(std::lround(extent.width * _scale)), 1u),
+            std::max(static_cast<uint32_t>(std::lround(extent.height * _scale)), 1u)
+        };
+    }
+}
@@ -0,0 +1,86 @@
+#include "EmbeddedShaders.h"
+
+#include <iterator>
+
+// The .inc files are generated with glslc -mfmt=num, a comma-separated list of the SPIR-V words
+#if __has_include("../shaders/embedded/shader.vert.inc") && \
+    __has_include("../shaders/embedded/depth.vert.inc") && \
+    __has_include("../shaders/embedded/shader.frag.inc") && \
+    __has_include("../shaders/embedded/shader.frag.alpha_test.inc") && \
+    __has_include("../shaders/embedded/cull.comp.inc") && \
+    __has_include("../shaders/embedded/depthreduce.comp.inc")
+    #define HAS_EMBEDDED_SHADERS
+#endif
+
+namespace Vulkan
+{
+#ifdef HAS_EMBEDDED_SHADERS
+    namespace
+    {
+        alignas(4) constexpr uint32_t SHADER_VERT[]
+        {
+            #include "../shaders/embedded/shader.vert.inc"
+        };
+
+        alignas(4) constexpr uint32_t SHADER_DEPTH_VERT[]
+        {
+            #include "../shaders/embedded/depth.vert.inc"
+        };
+
+        alignas(4) constexpr uint32_t SHADER_FRAG[]
+        {
+            #include "../shaders/embedded/shader.frag.inc"
+        };
+
+        alignas(4) constexpr uint32_t SHADER_FRAG_ALPHA_TEST[]
+        {
+            #include "../shaders/embedded/shader.frag.alpha_test.inc"
+        };
+
+        alignas(4) constexpr uint32_t SHADER_CULL_COMP[]
+        {
+            #include "../shaders/embedded/cull.comp.inc"
+        };
+
+        alignas(4) constexpr uint32_t SHADER_DEPTH_REDUCE_COMP[]
+        {
+            #include "../shaders/embedded/depthreduce.comp.inc"
+        };
+
+        constexpr EmbeddedShader EMBEDDED_SHADERS[]
+        {
+            { "shaders/shader.vert",              SHADER_VERT,              std::size(SHADER_VERT) },
+            { "shaders/depth.vert",               SHADER_DEPTH_VERT,        std::size(SHADER_DEPTH_VERT) },
+            { "shaders/shader.frag",              SHADER_FRAG,              std::size(SHADER_FRAG) },
+            { "shaders/shader.frag|ALPHA_TEST=1", SHADER_FRAG_ALPHA_TEST,   std::size(SHADER_FRAG_ALPHA_TEST) },
+            { "shaders/cull.comp",                SHADER_CULL_COMP,         std::size(SHADER_CULL_COMP) },
+            { "shaders/depthreduce.comp",         SHADER_DEPTH_REDUCE_COMP, std::size(SHADER_DEPTH_REDUCE_COMP) },
+        };
+    }
+
+    bool HasEmbeddedShaders()
+    {
+        return true;
+    }
+
+    const EmbeddedShader* FindEmbeddedShader(const std::string& key)
+    {
+        for (const EmbeddedShader& shader : EMBEDDED_SHADERS)
+        {
+            if (key == shader.key)
+                return &shader;
+        }
+        return nullptr;
+    }
+#else
+    bool HasEmbeddedShaders()
+    {
+        return false;
+    }
+
+    const EmbeddedShader* FindEmbeddedShader(const std::string& /*key*/)
+    {
+        return nullptr;
+    }
+#endif
+}
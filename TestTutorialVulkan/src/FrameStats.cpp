@@ -0,0 +1,81 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace Vulkan
+{
+    void FrameStats::BeginFrame(uint64_t timelineValue, PresentPolicy policy)
+    {
+        Clock::time_point now { Clock::now() };
+
+        // The switch to another policy waits on every frame in flight, not counted against either
+        if (_lastStartTime.has_value() && _lastPolicy == policy)
+        {
+            double seconds { std::chrono::duration<double>(now - _lastStartTime.value()).count() };
+            for (Totals* totals : { &_totals[policy], &_intervalTotals[policy] })
+            {
+                ++totals->frameCount;
+                totals->seconds += seconds;
+            }
+        }
+
+        _lastStartTime = now;
+        _lastPolicy = policy;
+        _pendingFrames.push_back({ timelineValue, policy, now });
+    }
+
+    void FrameStats::CompleteFrames(uint64_t completedValue)
+    {
+        Clock::time_point now { Clock::now() };
+
+        while (!_pendingFrames.empty() && _pendingFrames.front().timelineValue <= completedValue)
+        {
+            const PendingFrame& frame { _pendingFrames.front() };
+            double latency { std::chrono::duration<double>(now - frame.startTime).count() };
+            for (Totals* totals : { &_totals[frame.policy], &_intervalTotals[frame.policy] })
+            {
+                ++totals->completedCount;
+                totals->latencySum += latency;
+                totals->latencyMax = std::max(totals->latencyMax, latency);
+            }
+
+            _pendingFrames.pop_front();
+        }
+    }
+
+    void FrameStats::ReportInterval(std::ostream& stream)
+    {
+        for (size_t i = 0; i < _intervalTotals.size(); ++i)
+        {
+            if (_intervalTotals[i].frameCount > 0)
+            {
+                Print(stream, static_cast<PresentPolicy>(i), _intervalTotals[i]);
+            }
+        }
+        _intervalTotals = {};
+    }
+
+    void FrameStats::ReportTotals(std::ostream& stream) const
+    {
+        for (size_t i = 0; i < _totals.size(); ++i)
+        {
+            if (_totals[i].frameCount > 0)
+            {
+                Print(stream, static_cast<PresentPolicy>(i), _totals[i]);
+            }
+        }
+    }
+
+    void FrameStats::Print(std::ostream& stream, PresentPolicy policy, const Totals& totals)
+    {
+        double latencyAverage { totals.completedCount > 0 ? totals.latencySum / totals.completedCount : 0.0 };
+
+        stream << std::fixed << std::setprecision(2)
+            << "Present policy " << GetPresentPolicySettings(policy).name << ": "
+            << totals.frameCount / totals.seconds << " fps, latency "
+            << latencyAverage * 1000.0 << " ms average, "
+            << totals.latencyMax * 1000.0 << " ms max" << std::endl;
+        stream << std::defaultfloat;
+    }
+}
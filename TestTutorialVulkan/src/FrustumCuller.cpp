@@ -0,0 +1,147 @@
+#include "FrustumCuller.h"
+
+#include <algorithm>
+#include <future>
+
+// SSE2 is part of x64, 32-bit builds only have it when the compiler is told so
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLER_SSE
+#include <emmintrin.h>
+#endif
+
+namespace Vulkan
+{
+    void FrustumCuller::Resize(size_t count)
+    {
+        size_t paddedCount { (count + SPHERES_PER_TEST - 1) / SPHERES_PER_TEST * SPHERES_PER_TEST };
+
+        _centersX.resize(paddedCount);
+        _centersY.resize(paddedCount);
+        _centersZ.resize(paddedCount);
+        _radii.resize(paddedCount);
+        _count = count;
+    }
+
+    void FrustumCuller::SetSphere(size_t index, const glm::vec3& center, float radius)
+    {
+        _centersX[index] = center.x;
+        _centersY[index] = center.y;
+        _centersZ[index] = center.z;
+        _radii[index] = radius;
+    }
+
+    void FrustumCuller::Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+    {
+        visible.clear();
+        CullRange(frustum, 0, _count, visible);
+    }
+
+    void FrustumCuller::Cull(const Frustum& frustum, ThreadPool& threadPool, std::vector<uint32_t>& visible) const
+    {
+        size_t taskCount { std::min(threadPool.GetWorkerCount(), _count / MIN_SPHERES_PER_TASK) };
+        if (taskCount <= 1)
+        {
+            Cull(frustum, visible);
+            return;
+        }
+
+        // Ranges start on a multiple of SPHERES_PER_TEST, each task fills its own list
+        size_t spheresPerTask { (_count + taskCount - 1) / taskCount };
+        spheresPerTask = (spheresPerTask + SPHERES_PER_TEST - 1) / SPHERES_PER_TEST * SPHERES_PER_TEST;
+
+        std::vector<std::vector<uint32_t>> taskVisibles(taskCount);
+        std::vector<std::future<void>> tasks;
+        tasks.reserve(taskCount);
+        for (size_t task = 0; task < taskCount; ++task)
+        {
+            size_t first { std::min(task * spheresPerTask, _count) };
+            size_t last { std::min(first + spheresPerTask, _count) };
+
+            tasks.push_back(threadPool.Submit([&, task, first, last]()
+            {
+                CullRange(frustum, first, last, taskVisibles[task]);
+            }));
+        }
+
+        // The tasks reference the lists, none may still be running if one of them threw
+        for (std::future<void>& task : tasks)
+        {
+            task.wait();
+        }
+        for (std::future<void>& task : tasks)
+        {
+            task.get();
+        }
+
+        // In task order, the indices stay sorted
+        visible.clear();
+        for (const std::vector<uint32_t>& taskVisible : taskVisibles)
+        {
+            visible.insert(visible.end(), taskVisible.begin(), taskVisible.end());
+        }
+    }
+
+    void FrustumCuller::CullRange(const Frustum& frustum, size_t first, size_t last, std::vector<uint32_t>& visible) const
+    {
+#ifdef FRUSTUM_CULLER_SSE
+        // Each component of each plane broadcast to the four lanes
+        __m128 planesX[Frustum::PLANE_COUNT];
+        __m128 planesY[Frustum::PLANE_COUNT];
+        __m128 planesZ[Frustum::PLANE_COUNT];
+        __m128 planesW[Frustum::PLANE_COUNT];
+        for (size_t p = 0; p < Frustum::PLANE_COUNT; ++p)
+        {
+            planesX[p] = _mm_set1_ps(frustum.planes[p].x);
+            planesY[p] = _mm_set1_ps(frustum.planes[p].y);
+            planesZ[p] = _mm_set1_ps(frustum.planes[p].z);
+            planesW[p] = _mm_set1_ps(frustum.planes[p].w);
+        }
+
+        __m128 signMask { _mm_set1_ps(-0.0f) };
+
+        for (size_t i = first; i < last; i += SPHERES_PER_TEST)
+        {
+            __m128 x { _mm_loadu_ps(&_centersX[i]) };
+            __m128 y { _mm_loadu_ps(&_centersY[i]) };
+            __m128 z { _mm_loadu_ps(&_centersZ[i]) };
+            __m128 negativeRadius { _mm_xor_ps(_mm_loadu_ps(&_radii[i]), signMask) };
+
+            // A sphere is outside as soon as it is entirely behind one plane
+            __m128 inside { _mm_castsi128_ps(_mm_set1_epi32(-1)) };
+            for (size_t p = 0; p < Frustum::PLANE_COUNT; ++p)
+            {
+                __m128 distance { _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(x, planesX[p]), _mm_mul_ps(y, planesY[p])),
+                    _mm_add_ps(_mm_mul_ps(z, planesZ[p]), planesW[p])) };
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+            }
+
+            int mask { _mm_movemask_ps(inside) };
+            for (size_t lane = 0; mask != 0 && lane < SPHERES_PER_TEST; ++lane, mask >>= 1)
+            {
+                // The padding past the last sphere is skipped
+                if ((mask & 1) && i + lane < last)
+                {
+                    visible.push_back(static_cast<uint32_t>(i + lane));
+                }
+            }
+        }
+#else
+        for (size_t i = first; i < last; ++i)
+        {
+            bool inside { true };
+            for (size_t p = 0; p < Frustum::PLANE_COUNT && inside; ++p)
+            {
+                const glm::vec4& plane { frustum.planes[p] };
+                float distance { plane.x * _centersX[i] + plane.y * _centersY[i] + plane.z * _centersZ[i] + plane.w };
+                inside = distance >= -_radii[i];
+            }
+
+            if (inside)
+            {
+                visible.push_back(static_cast<uint32_t>(i));
+            }
+        }
+#endif
+    }
+}
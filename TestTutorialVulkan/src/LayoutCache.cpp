@@ -0,0 +1,143 @@
+#include "LayoutCache.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Vulkan
+{
+    namespace
+    {
+        // Same mixing as boost::hash_combine
+        void HashCombine(size_t& seed, uint64_t value)
+        {
+            seed ^= std::hash<uint64_t>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        }
+    }
+
+    bool LayoutCache::DescriptorSetLayoutKey::operator==(const DescriptorSetLayoutKey& other) const
+    {
+        return std::equal(bindings.begin(), bindings.end(), other.bindings.begin(), other.bindings.end(),
+            [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b)
+            {
+                return a.binding == b.binding
+                    && a.descriptorType == b.descriptorType
+                    && a.descriptorCount == b.descriptorCount
+                    && a.stageFlags == b.stageFlags
+                    && a.pImmutableSamplers == b.pImmutableSamplers;
+            });
+    }
+
+    size_t LayoutCache::DescriptorSetLayoutKey::Hash() const
+    {
+        size_t hash { bindings.size() };
+        for (const VkDescriptorSetLayoutBinding& binding : bindings)
+        {
+            HashCombine(hash, binding.binding);
+            HashCombine(hash, binding.descriptorType);
+            HashCombine(hash, binding.descriptorCount);
+            HashCombine(hash, binding.stageFlags);
+        }
+        return hash;
+    }
+
+    bool LayoutCache::PipelineLayoutKey::operator==(const PipelineLayoutKey& other) const
+    {
+        return setLayouts == other.setLayouts
+            && std::equal(pushConstantRanges.begin(), pushConstantRanges.end(), other.pushConstantRanges.begin(), other.pushConstantRanges.end(),
+                [](const VkPushConstantRange& a, const VkPushConstantRange& b)
+                {
+                    return a.stageFlags == b.stageFlags && a.offset == b.offset && a.size == b.size;
+                });
+    }
+
+    size_t LayoutCache::PipelineLayoutKey::Hash() const
+    {
+        size_t hash { setLayouts.size() };
+        for (VkDescriptorSetLayout setLayout : setLayouts)
+        {
+            HashCombine(hash, reinterpret_cast<uint64_t>(setLayout));
+        }
+        for (const VkPushConstantRange& range : pushConstantRanges)
+        {
+            HashCombine(hash, range.stageFlags);
+            HashCombine(hash, range.offset);
+            HashCombine(hash, range.size);
+        }
+        return hash;
+    }
+
+    LayoutCache::LayoutCache(VkDevice device)
+        : _device { device }
+    {
+    }
+
+    VkDescriptorSetLayout LayoutCache::GetDescriptorSetLayout(std::vector<VkDescriptorSetLayoutBinding> bindings)
+    {
+        // The same bindings declared in another order are the same layout
+        std::sort(bindings.begin(), bindings.end(),
+            [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+        DescriptorSetLayoutKey key { std::move(bindings) };
+
+        auto it { _descriptorSetLayouts.find(key) };
+        if (it != _descriptorSetLayouts.end())
+            return it->second;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(key.bindings.size());
+        layoutInfo.pBindings = key.bindings.data();
+
+        VkDescriptorSetLayout descriptorSetLayout;
+        if (vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+
+        _descriptorSetLayouts.emplace(std::move(key), descriptorSetLayout);
+        return descriptorSetLayout;
+    }
+
+    VkPipelineLayout LayoutCache::GetPipelineLayout(
+        const std::vector<VkDescriptorSetLayout>& setLayouts,
+        const std::vector<VkPushConstantRange>& pushConstantRanges)
+    {
+        PipelineLayoutKey key { setLayouts, pushConstantRanges };
+
+        auto it { _pipelineLayouts.find(key) };
+        if (it != _pipelineLayouts.end())
+            return it->second;
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(key.setLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = key.setLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(key.pushConstantRanges.size());
+        pipelineLayoutInfo.pPushConstantRanges = key.pushConstantRanges.data();
+
+        VkPipelineLayout pipelineLayout;
+        if (vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create pipeline layout!");
+        }
+
+        _pipelineLayouts.emplace(std::move(key), pipelineLayout);
+        return pipelineLayout;
+    }
+
+    void LayoutCache::Destroy()
+    {
+        // Pipeline layouts first, they reference the set layouts
+        for (const auto& [key, pipelineLayout] : _pipelineLayouts)
+        {
+            vkDestroyPipelineLayout(_device, pipelineLayout, nullptr);
+        }
+        _pipelineLayouts.clear();
+
+        for (const auto& [key, descriptorSetLayout] : _descriptorSetLayouts)
+        {
+            vkDestroyDescriptorSetLayout(_device, descriptorSetLayout, nullptr);
+        }
+        _descriptorSetLayouts.clear();
+    }
+}
@@ -3,12 +3,14 @@
 #include <iostream>
 #include <stdexcept>
 
-int main() 
+int main(int argc, char** argv)
 {
-	Vulkan::Application app;
-    
     try
     {
+        // Optional present policy : low-latency, throughput or vsync
+        Vulkan::PresentPolicy presentPolicy { argc > 1 ? Vulkan::ParsePresentPolicy(argv[1]) : Vulkan::PRESENT_POLICY_VSYNC };
+
+        Vulkan::Application app { presentPolicy };
         app.Run();
     }
     catch(const std::exception& e)
@@ -0,0 +1,368 @@
+#include "ObjStreamReader.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+namespace Vulkan
+{
+    namespace
+    {
+        std::filesystem::path MakeSpillPath(const std::string& filename, const char* attribute)
+        {
+            // Unique per reader so concurrent loads of the same model do not share the files
+            std::random_device random;
+            std::string name { std::filesystem::path(filename).stem().string() + "." + std::to_string(random()) + "." + attribute };
+            return std::filesystem::temp_directory_path() / name;
+        }
+    }
+
+    ObjStreamReader::AttributeSpill::AttributeSpill(uint32_t stride)
+        : _stride { stride }
+    {
+    }
+
+    ObjStreamReader::AttributeSpill::~AttributeSpill()
+    {
+        Close();
+    }
+
+    void ObjStreamReader::AttributeSpill::Open(const std::filesystem::path& path)
+    {
+        Close();
+
+        _path = path;
+        _file.open(_path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+
+        if (!_file.is_open())
+        {
+            throw std::runtime_error("Failed to create temporary file: " + _path.string());
+        }
+
+        _count = 0;
+        _pages.resize(static_cast<size_t>(CACHE_PAGES) * PAGE_RECORDS * _stride);
+        _pageTags.assign(CACHE_PAGES, 0);
+    }
+
+    void ObjStreamReader::AttributeSpill::Append(const float* record)
+    {
+        _file.write(reinterpret_cast<const char*>(record), _stride * sizeof(float));
+        ++_count;
+    }
+
+    const float* ObjStreamReader::AttributeSpill::Get(uint32_t index)
+    {
+        uint32_t page { index / PAGE_RECORDS };
+        uint32_t slot { page % CACHE_PAGES };
+        float* records { _pages.data() + static_cast<size_t>(slot) * PAGE_RECORDS * _stride };
+
+        if (_pageTags[slot] != page + 1)
+        {
+            uint32_t first { page * PAGE_RECORDS };
+            uint32_t count { std::min(PAGE_RECORDS, _count - first) };
+
+            // Also moves from writing to reading after the last Append()
+            _file.seekg(static_cast<std::streamoff>(first) * _stride * sizeof(float));
+            _file.read(reinterpret_cast<char*>(records), static_cast<std::streamsize>(count) * _stride * sizeof(float));
+
+            if (!_file)
+            {
+                throw std::runtime_error("Failed to read temporary file: " + _path.string());
+            }
+
+            _pageTags[slot] = page + 1;
+        }
+
+        return records + static_cast<size_t>(index % PAGE_RECORDS) * _stride;
+    }
+
+    void ObjStreamReader::AttributeSpill::Close()
+    {
+        if (_file.is_open())
+        {
+            _file.close();
+
+            std::error_code error;
+            std::filesystem::remove(_path, error);
+        }
+
+        _count = 0;
+        std::vector<float>().swap(_pages);
+        std::vector<uint32_t>().swap(_pageTags);
+    }
+
+    ObjStreamReader::ObjStreamReader(const std::string& filename)
+        : _filename { filename }
+        , _chunk(CHUNK_SIZE + 1)
+    {
+    }
+
+    template<typename LineFn>
+    void ObjStreamReader::ForEachLine(LineFn&& fn)
+    {
+        std::ifstream file { _filename, std::ios::binary };
+
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Failed to open model file: " + _filename);
+        }
+
+        // Bytes of an incomplete line carried over from the previous chunk
+        size_t carry { 0 };
+
+        while (true)
+        {
+            file.read(_chunk.data() + carry, CHUNK_SIZE - carry);
+            size_t size { carry + static_cast<size_t>(file.gcount()) };
+            bool isEof { file.eof() || file.gcount() == 0 };
+
+            if (size == 0)
+                break;
+
+            char* begin { _chunk.data() };
+            char* end   { _chunk.data() + size };
+
+            while (begin < end)
+            {
+                char* newline { static_cast<char*>(memchr(begin, '\n', end - begin)) };
+
+                if (newline == nullptr)
+                {
+                    if (!isEof)
+                        break;
+
+                    // Last line of the file without a trailing newline
+                    newline = end;
+                }
+
+                *newline = '\0';
+                if (newline > begin && newline[-1] == '\r')
+                    newline[-1] = '\0';
+
+                fn(begin);
+
+                begin = newline + 1;
+            }
+
+            if (isEof)
+                break;
+
+            carry = static_cast<size_t>(end - begin);
+            if (carry == CHUNK_SIZE)
+            {
+                throw std::runtime_error("Line longer than the OBJ chunk size in: " + _filename);
+            }
+
+            memmove(_chunk.data(), begin, carry);
+        }
+    }
+
+    template<typename CornerFn>
+    void ObjStreamReader::ParseFace(char* line, uint32_t positionCount, uint32_t texcoordCount, CornerFn&& fn)
+    {
+        // OBJ indices are 1-based, negative values are relative to the end of the current list
+        auto resolve = [](long index, uint32_t count) -> int32_t
+        {
+            if (index > 0)           return static_cast<int32_t>(index - 1);
+            if (index < 0)           return static_cast<int32_t>(count) + static_cast<int32_t>(index);
+            return -1;
+        };
+
+        int32_t first[2] {};
+        int32_t previous[2] {};
+        int corner { 0 };
+
+        char* cursor { line };
+        while (true)
+        {
+            // A comment may follow the last corner
+            while (*cursor == ' ' || *cursor == '\t') ++cursor;
+            if (*cursor == '\0' || *cursor == '#') break;
+
+            // Tokens : v, v/vt, v//vn, v/vt/vn
+            long v { strtol(cursor, &cursor, 10) };
+            long vt { 0 };
+            if (*cursor == '/')
+            {
+                ++cursor;
+                if (*cursor != '/')
+                    vt = strtol(cursor, &cursor, 10);
+                if (*cursor == '/')
+                {
+                    ++cursor;
+                    strtol(cursor, &cursor, 10);
+                }
+            }
+
+            while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '#') ++cursor;
+
+            int32_t current[2] { resolve(v, positionCount), resolve(vt, texcoordCount) };
+            // A missing vt resolves to -1, one given has to land in the list like v
+            if (current[0] < 0 || current[0] >= static_cast<int32_t>(positionCount)
+                || (vt != 0 && (current[1] < 0 || current[1] >= static_cast<int32_t>(texcoordCount))))
+            {
+                throw std::runtime_error("Invalid face index in: " + _filename);
+            }
+
+            // Triangulate the polygon as a fan around its first corner
+            if (corner == 0)
+            {
+                first[0] = current[0];
+                first[1] = current[1];
+            }
+            else if (corner >= 2)
+            {
+                fn(first[0], first[1]);
+                fn(previous[0], previous[1]);
+                fn(current[0], current[1]);
+            }
+
+            previous[0] = current[0];
+            previous[1] = current[1];
+            ++corner;
+        }
+    }
+
+    bool ObjStreamReader::FindOrInsert(int32_t positionIndex, int32_t texcoordIndex, uint32_t& vertexCount, uint32_t& index)
+    {
+        uint64_t key { (static_cast<uint64_t>(positionIndex + 1) << 32) | static_cast<uint32_t>(texcoordIndex + 1) };
+        size_t slot { static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> (64 - VERTEX_CACHE_BITS)) };
+
+        CacheEntry& entry { _vertexCache[slot] };
+        if (entry.key == key)
+        {
+            index = entry.index;
+            return false;
+        }
+
+        entry.key = key;
+        entry.index = vertexCount;
+        index = vertexCount++;
+        return true;
+    }
+
+    const ObjStreamReader::Counts& ObjStreamReader::Scan()
+    {
+        _counts = {};
+        _vertexCache.assign(VERTEX_CACHE_SIZE, CacheEntry {});
+
+        _positions.Open(MakeSpillPath(_filename, "positions"));
+        _texcoords.Open(MakeSpillPath(_filename, "texcoords"));
+
+        ForEachLine([this](char* line)
+        {
+            if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t'))
+            {
+                float position[3];
+                char* cursor { line + 2 };
+                for (float& value : position)
+                    value = strtof(cursor, &cursor);
+
+                _positions.Append(position);
+                ++_counts.positions;
+            }
+            else if (line[0] == 'v' && line[1] == 't' && (line[2] == ' ' || line[2] == '\t'))
+            {
+                float texcoord[2];
+                char* cursor { line + 3 };
+                for (float& value : texcoord)
+                    value = strtof(cursor, &cursor);
+
+                _texcoords.Append(texcoord);
+                ++_counts.texcoords;
+            }
+            else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t'))
+            {
+                ParseFace(line + 2, _counts.positions, _counts.texcoords, [this](int32_t v, int32_t vt)
+                {
+                    uint32_t index;
+                    FindOrInsert(v, vt, _counts.vertices, index);
+                    ++_counts.indices;
+                });
+            }
+        });
+
+        _isScanned = true;
+        return _counts;
+    }
+
+    void ObjStreamReader::Stream(
+        Vertex*   vertexBatch, size_t vertexCapacity, const Sink& vertexSink,
+        uint32_t* indexBatch,  size_t indexCapacity,  const Sink& indexSink)
+    {
+        if (!_isScanned)
+            Scan();
+
+        _vertexCache.assign(VERTEX_CACHE_SIZE, CacheEntry {});
+
+        // Running counts, negative face indices are relative to the lines read so far
+        uint32_t positionCount { 0 };
+        uint32_t texcoordCount { 0 };
+
+        uint32_t vertexCount { 0 };
+        size_t vertexFill { 0 };
+        size_t indexFill { 0 };
+
+        ForEachLine([&](char* line)
+        {
+            if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t'))
+            {
+                ++positionCount;
+            }
+            else if (line[0] == 'v' && line[1] == 't' && (line[2] == ' ' || line[2] == '\t'))
+            {
+                ++texcoordCount;
+            }
+            else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t'))
+            {
+                ParseFace(line + 2, positionCount, texcoordCount, [&](int32_t v, int32_t vt)
+                {
+                    uint32_t index;
+                    if (FindOrInsert(v, vt, vertexCount, index))
+                    {
+                        Vertex& vertex { vertexBatch[vertexFill++] };
+
+                        const float* position { _positions.Get(static_cast<uint32_t>(v)) };
+                        vertex.position = { position[0], position[1], position[2] };
+
+                        if (vt < 0)
+                        {
+                            vertex.uv = glm::vec2(0.0f);
+                        }
+                        else
+                        {
+                            const float* texcoord { _texcoords.Get(static_cast<uint32_t>(vt)) };
+                            vertex.uv = { texcoord[0], 1.0f - texcoord[1] };
+                        }
+
+                        vertex.color = { 1.0f, 1.0f, 1.0f };
+
+                        if (vertexFill == vertexCapacity)
+                        {
+                            vertexSink(vertexFill);
+                            vertexFill = 0;
+                        }
+                    }
+
+                    indexBatch[indexFill++] = index;
+                    if (indexFill == indexCapacity)
+                    {
+                        indexSink(indexFill);
+                        indexFill = 0;
+                    }
+                });
+            }
+        });
+
+        if (vertexFill > 0) vertexSink(vertexFill);
+        if (indexFill > 0)  indexSink(indexFill);
+
+        // Drop the spilled attributes right away, the GPU owns the data now
+        _positions.Close();
+        _texcoords.Close();
+        _isScanned = false;
+        std::vector<CacheEntry>().swap(_vertexCache);
+    }
+}
@@ -0,0 +1,164 @@
+#include "PipelineCompiler.h"
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace Vulkan
+{
+    PipelineCompiler::PipelineCompiler(VkDevice device, VkPipelineCache pipelineCache, ThreadPool& threadPool)
+        : _device { device }
+        , _pipelineCache { pipelineCache }
+        , _threadPool { threadPool }
+    {
+    }
+
+    std::shared_future<VkPipeline> PipelineCompiler::Submit(GraphicsPipelineDescription description)
+    {
+        VkDevice device { _device };
+        VkPipelineCache pipelineCache { _pipelineCache };
+
+        return _threadPool.Submit([device, pipelineCache, description = std::move(description)]()
+        {
+            return Compile(device, pipelineCache, description);
+        }).share();
+    }
+
+    std::vector<std::shared_future<VkPipeline>> PipelineCompiler::Submit(std::vector<GraphicsPipelineDescription> descriptions)
+    {
+        std::vector<std::shared_future<VkPipeline>> pipelines;
+        pipelines.reserve(descriptions.size());
+
+        for (GraphicsPipelineDescription& description : descriptions)
+        {
+            pipelines.push_back(Submit(std::move(description)));
+        }
+
+        return pipelines;
+    }
+
+    VkPipeline PipelineCompiler::Compile(VkDevice device, VkPipelineCache pipelineCache, const GraphicsPipelineDescription& description)
+    {
+        auto startTime { std::chrono::high_resolution_clock::now() };
+
+        // ==== Shader stages ==== //
+        std::vector<VkShaderModule> shaderModules;
+        std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+        std::vector<VkSpecializationInfo> specializationInfos;
+        shaderModules.reserve(description.stages.size());
+        shaderStages.reserve(description.stages.size());
+        // Reserved so the pointers to the elements stay valid
+        specializationInfos.reserve(description.stages.size());
+
+        auto destroyShaderModules = [&]()
+        {
+            for (VkShaderModule shaderModule : shaderModules)
+            {
+                vkDestroyShaderModule(device, shaderModule, nullptr);
+            }
+        };
+
+        for (const ShaderStageDescription& stage : description.stages)
+        {
+            VkShaderModuleCreateInfo moduleInfo {};
+            moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+            moduleInfo.codeSize = stage.code.wordCount * sizeof(uint32_t);
+            moduleInfo.pCode = stage.code.words;
+
+            VkShaderModule shaderModule;
+            if (vkCreateShaderModule(device, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS)
+            {
+                destroyShaderModules();
+                throw std::runtime_error("failed to create shader module!");
+            }
+            shaderModules.push_back(shaderModule);
+
+            VkPipelineShaderStageCreateInfo stageInfo {};
+            stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            stageInfo.stage = stage.stage;
+            stageInfo.module = shaderModule;
+            stageInfo.pName = stage.entryPoint.c_str();
+
+            if (!stage.specializationMapEntries.empty())
+            {
+                VkSpecializationInfo specializationInfo {};
+                specializationInfo.mapEntryCount = static_cast<uint32_t>(stage.specializationMapEntries.size());
+                specializationInfo.pMapEntries = stage.specializationMapEntries.data();
+                specializationInfo.dataSize = stage.specializationData.size();
+                specializationInfo.pData = stage.specializationData.data();
+
+                specializationInfos.push_back(specializationInfo);
+                stageInfo.pSpecializationInfo = &specializationInfos.back();
+            }
+
+            shaderStages.push_back(stageInfo);
+        }
+
+        // ==== Fixed functions ==== //
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo {};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(description.vertexBindings.size());
+        vertexInputInfo.pVertexBindingDescriptions = description.vertexBindings.data();
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(description.vertexAttributes.size());
+        vertexInputInfo.pVertexAttributeDescriptions = description.vertexAttributes.data();
+
+        VkPipelineViewportStateCreateInfo viewportState {};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = description.viewportCount;
+        viewportState.scissorCount = description.viewportCount;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending { description.colorBlending };
+        colorBlending.attachmentCount = static_cast<uint32_t>(description.colorBlendAttachments.size());
+        colorBlending.pAttachments = description.colorBlendAttachments.data();
+
+        VkPipelineDynamicStateCreateInfo dynamicState {};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = static_cast<uint32_t>(description.dynamicStates.size());
+        dynamicState.pDynamicStates = description.dynamicStates.data();
+
+        VkGraphicsPipelineCreateInfo pipelineInfo {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+        pipelineInfo.pStages = shaderStages.data();
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &description.inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &description.rasterizer;
+        pipelineInfo.pMultisampleState = &description.multisampling;
+        pipelineInfo.pDepthStencilState = &description.depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = description.dynamicStates.empty() ? nullptr : &dynamicState;
+
+        pipelineInfo.layout = description.layout;
+
+        pipelineInfo.renderPass = description.renderPass;
+        pipelineInfo.subpass = description.subpass;
+
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
+        pipelineInfo.basePipelineIndex = -1; // Optional
+
+        VkPipeline graphicsPipeline;
+        VkResult result { vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipeline) };
+
+        // The driver keeps what it needs, the modules are not referenced by the pipeline
+        destroyShaderModules();
+
+        if (result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create graphics pipeline!");
+        }
+
+        auto endTime { std::chrono::high_resolution_clock::now() };
+
+        // One write per line, workers log concurrently
+        std::ostringstream log;
+        log << "Graphics pipeline " << description.name << " created in "
+            << std::chrono::duration<float, std::chrono::milliseconds::period>(endTime - startTime).count() << " ms"
+            << " (thread " << std::this_thread::get_id() << ")\n";
+        std::cout << log.str();
+
+        return graphicsPipeline;
+    }
+}
@@ -0,0 +1,102 @@
+#include "PipelineStateCache.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace Vulkan
+{
+    PipelineStateCache::PipelineStateCache(PipelineCompiler& compiler, DescribeFunction describe)
+        : _compiler { compiler }
+        , _describe { std::move(describe) }
+    {
+    }
+
+    void PipelineStateCache::Request(const std::vector<PipelineStateKey>& states)
+    {
+        std::vector<std::pair<PipelineStateKey, Entry>> requested;
+        std::vector<GraphicsPipelineDescription> descriptions;
+
+        for (const PipelineStateKey& state : states)
+        {
+            auto isRequested = [&](const auto& entry) { return entry.first == state; };
+            if (_pipelines.count(state) != 0 ||
+                std::find_if(requested.begin(), requested.end(), isRequested) != requested.end())
+                continue;
+
+            Entry entry {};
+            descriptions.push_back(_describe(state, entry.shaders));
+            requested.emplace_back(state, std::move(entry));
+        }
+
+        // Only inserted once submitted, an entry never holds an empty future
+        std::vector<std::shared_future<VkPipeline>> pipelines { _compiler.Submit(std::move(descriptions)) };
+        for (size_t i = 0; i < requested.size(); ++i)
+        {
+            requested[i].second.pipeline = pipelines[i];
+            _pipelines.emplace(std::move(requested[i]));
+        }
+    }
+
+    VkPipeline PipelineStateCache::Get(const PipelineStateKey& state, bool isWaiting)
+    {
+        auto it { _pipelines.find(state) };
+        if (it == _pipelines.end())
+        {
+            Request({ state });
+            it = _pipelines.find(state);
+        }
+
+        if (!isWaiting && !PipelineCompiler::IsReady(it->second.pipeline))
+            return VK_NULL_HANDLE;
+
+        return it->second.pipeline.get();
+    }
+
+    void PipelineStateCache::WaitAll()
+    {
+        for (const auto& [state, entry] : _pipelines)
+        {
+            entry.pipeline.get();
+        }
+    }
+
+    std::vector<std::shared_future<VkPipeline>> PipelineStateCache::Rebuild(const std::vector<std::string>& changedShaders)
+    {
+        std::vector<std::shared_future<VkPipeline>> oldPipelines;
+
+        for (auto& [state, entry] : _pipelines)
+        {
+            bool isAffected { false };
+            for (const std::string& shader : changedShaders)
+            {
+                isAffected |= std::find(entry.shaders.begin(), entry.shaders.end(), shader) != entry.shaders.end();
+            }
+
+            if (!isAffected)
+                continue;
+
+            std::vector<std::string> shaders;
+            std::shared_future<VkPipeline> pipeline { _compiler.Submit(_describe(state, shaders)) };
+
+            oldPipelines.push_back(std::move(entry.pipeline));
+            entry.pipeline = std::move(pipeline);
+            entry.shaders = std::move(shaders);
+        }
+
+        return oldPipelines;
+    }
+
+    std::vector<std::shared_future<VkPipeline>> PipelineStateCache::Clear()
+    {
+        std::vector<std::shared_future<VkPipeline>> pipelines;
+        pipelines.reserve(_pipelines.size());
+
+        for (auto& [state, entry] : _pipelines)
+        {
+            pipelines.push_back(std::move(entry.pipeline));
+        }
+        _pipelines.clear();
+
+        return pipelines;
+    }
+}
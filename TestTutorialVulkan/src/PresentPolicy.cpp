@@ -0,0 +1,45 @@
+#include "PresentPolicy.h"
+
+#include <array>
+#include <stdexcept>
+
+namespace Vulkan
+{
+    namespace
+    {
+        const std::array<PresentPolicySettings, PRESENT_POLICY_COUNT> PRESENT_POLICY_SETTINGS
+        {{
+            { "low-latency", { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR }, 1 },
+            { "throughput",  { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR }, 3 },
+            { "vsync",       { VK_PRESENT_MODE_FIFO_KHR }, 2 }
+        }};
+    }
+
+    const PresentPolicySettings& GetPresentPolicySettings(PresentPolicy policy)
+    {
+        return PRESENT_POLICY_SETTINGS.at(policy);
+    }
+
+    PresentPolicy ParsePresentPolicy(const std::string& name)
+    {
+        for (size_t i = 0; i < PRESENT_POLICY_SETTINGS.size(); ++i)
+        {
+            if (name == PRESENT_POLICY_SETTINGS[i].name)
+                return static_cast<PresentPolicy>(i);
+        }
+
+        throw std::invalid_argument("Unknown present policy " + name + ", expected low-latency, throughput or vsync!");
+    }
+
+    const char* GetPresentModeName(VkPresentModeKHR presentMode)
+    {
+        switch (presentMode)
+        {
+            case VK_PRESENT_MODE_IMMEDIATE_KHR:    return "IMMEDIATE";
+            case VK_PRESENT_MODE_MAILBOX_KHR:      return "MAILBOX";
+            case VK_PRESENT_MODE_FIFO_KHR:         return "FIFO";
+            case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+            default:                               return "UNKNOWN";
+        }
+    }
+}
@@ -0,0 +1,557 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <stdexcept>
+
+namespace Vulkan
+{
+    namespace
+    {
+        struct AccessInfo
+        {
+            VkPipelineStageFlags stages;
+            VkAccessFlags        access;
+            VkImageLayout        layout;
+            // Depends on the previous content, and changes it
+            bool isRead;
+            bool isWrite;
+        };
+
+        // Indexed by RenderGraphAccess
+        const std::array<AccessInfo, 12> ACCESS_INFOS
+        {{
+            { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, true, false },
+            { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, false, true },
+            { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+              VK_IMAGE_LAYOUT_GENERAL, true, false },
+            { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+              VK_IMAGE_LAYOUT_GENERAL, false, true },
+            { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+              VK_IMAGE_LAYOUT_GENERAL, true, true },
+            { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true, false },
+            { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+              VK_IMAGE_LAYOUT_UNDEFINED, true, false },
+            { VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true, false },
+            // Blending and depth testing read within the pass, not what was there before it
+            { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, false, true },
+            { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true, true },
+            { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+              VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, false, true },
+            { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+              VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true, true },
+        }};
+
+        constexpr VkAccessFlags WRITE_ACCESS_MASK
+        {
+            VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+            | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT
+        };
+
+        // What the later uses of a resource have to wait on
+        struct TrackedState
+        {
+            VkImageLayout        layout;
+            // Last write, or layout transition
+            VkPipelineStageFlags writeStages;
+            VkAccessFlags        writeAccess;
+            // Reads since the last write, a write has to wait for them
+            VkPipelineStageFlags readStages;
+            // Where the last write is already visible, the reads there need no barrier
+            VkPipelineStageFlags visibleStages;
+            VkAccessFlags        visibleAccess;
+        };
+
+        bool AreLifetimesDisjoint(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB)
+        {
+            return lastA < firstB || lastB < firstA;
+        }
+    }
+
+    RenderGraph::RenderGraph(VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties)
+        : _device { device }
+        , _memoryProperties { memoryProperties }
+    {
+    }
+
+    RenderGraph::Resource RenderGraph::ImportImage(const std::string& name, VkImageAspectFlags aspect, const RenderGraphState& initialState, const RenderGraphState& finalState)
+    {
+        ResourceEntry resource {};
+        resource.name = name;
+        resource.type = RESOURCE_TYPE_IMPORTED_IMAGE;
+        resource.aspect = aspect;
+        resource.initialState = initialState;
+        resource.finalState = finalState;
+        _resources.push_back(resource);
+
+        return static_cast<Resource>(_resources.size() - 1);
+    }
+
+    RenderGraph::Resource RenderGraph::ImportBuffer(const std::string& name, bool isPersistent)
+    {
+        ResourceEntry resource {};
+        resource.name = name;
+        resource.type = RESOURCE_TYPE_IMPORTED_BUFFER;
+        resource.isPersistent = isPersistent;
+        _resources.push_back(resource);
+
+        return static_cast<Resource>(_resources.size() - 1);
+    }
+
+    RenderGraph::Resource RenderGraph::CreateImage(const std::string& name, const RenderGraphImageDescription& description)
+    {
+        ResourceEntry resource {};
+        resource.name = name;
+        resource.type = RESOURCE_TYPE_TRANSIENT_IMAGE;
+        resource.aspect = description.aspect;
+        resource.description = description;
+        _resources.push_back(resource);
+
+        return static_cast<Resource>(_resources.size() - 1);
+    }
+
+    void RenderGraph::AddPass(const std::string& name, std::vector<Use> uses, std::function<void(VkCommandBuffer)> record)
+    {
+        PassEntry pass {};
+        pass.name = name;
+        pass.uses = std::move(uses);
+        pass.record = std::move(record);
+        _passes.push_back(std::move(pass));
+    }
+
+    void RenderGraph::Compile()
+    {
+        CullPasses();
+        AllocateTransients();
+        PlanBarriers();
+
+        size_t culledCount { static_cast<size_t>(std::count_if(_passes.begin(), _passes.end(), [](const PassEntry& pass) { return pass.isCulled; })) };
+        size_t transientCount { static_cast<size_t>(std::count_if(_resources.begin(), _resources.end(), [](const ResourceEntry& resource)
+        {
+            return resource.type == RESOURCE_TYPE_TRANSIENT_IMAGE && resource.isUsed;
+        })) };
+
+        std::cout << "Render graph: " << _passes.size() - culledCount << " passes (" << culledCount << " culled), "
+            << transientCount << " transient images in " << _memoryBlocks.size() << " allocations, "
+            << _transientMemorySize / 1024 << " KB instead of " << _unaliasedMemorySize / 1024 << " KB" << std::endl;
+    }
+
+    void RenderGraph::CullPasses()
+    {
+        // What outlives the frame is needed, then whatever a needed pass reads
+        std::vector<bool> isNeeded(_resources.size());
+        for (size_t i = 0; i < _resources.size(); ++i)
+        {
+            isNeeded[i] = _resources[i].type == RESOURCE_TYPE_IMPORTED_IMAGE
+                || (_resources[i].type == RESOURCE_TYPE_IMPORTED_BUFFER && _resources[i].isPersistent);
+        }
+
+        for (size_t i = _passes.size(); i-- > 0;)
+        {
+            PassEntry& pass { _passes[i] };
+
+            pass.isCulled = std::none_of(pass.uses.begin(), pass.uses.end(), [&](const Use& use)
+            {
+                return ACCESS_INFOS[use.access].isWrite && isNeeded[use.resource];
+            });
+
+            if (pass.isCulled)
+                continue;
+
+            for (const Use& use : pass.uses)
+            {
+                // Overwritten without being read, what earlier passes wrote to it is never seen
+                if (ACCESS_INFOS[use.access].isRead)
+                    isNeeded[use.resource] = true;
+                else if (ACCESS_INFOS[use.access].isWrite)
+                    isNeeded[use.resource] = false;
+            }
+        }
+    }
+
+    void RenderGraph::AllocateTransients()
+    {
+        for (ResourceEntry& resource : _resources)
+        {
+            resource.isUsed = false;
+        }
+
+        for (uint32_t i = 0; i < _passes.size(); ++i)
+        {
+            if (_passes[i].isCulled)
+                continue;
+
+            for (const Use& use : _passes[i].uses)
+            {
+                ResourceEntry& resource { _resources[use.resource] };
+                if (!resource.isUsed)
+                {
+                    resource.firstPass = i;
+                    resource.isUsed = true;
+                }
+                resource.lastPass = i;
+            }
+        }
+
+        struct MemoryBlock
+        {
+            VkMemoryRequirements requirements;
+            std::vector<Resource> residents;
+        };
+
+        std::vector<Resource> transients;
+        std::vector<VkMemoryRequirements> requirements(_resources.size());
+
+        for (Resource i = 0; i < _resources.size(); ++i)
+        {
+            ResourceEntry& resource { _resources[i] };
+            if (resource.type != RESOURCE_TYPE_TRANSIENT_IMAGE || !resource.isUsed)
+                continue;
+
+            VkImageCreateInfo imageInfo {};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent = { resource.description.extent.width, resource.description.extent.height, 1 };
+            imageInfo.mipLevels = resource.description.mipLevels;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = resource.description.format;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = resource.description.usage;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+
+            if (vkCreateImage(_device, &imageInfo, nullptr, &resource.image) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create render graph image!");
+            }
+
+            vkGetImageMemoryRequirements(_device, resource.image, &requirements[i]);
+            _unaliasedMemorySize += requirements[i].size;
+            transients.push_back(i);
+        }
+
+        // Largest first, the smaller ones fit in the blocks they leave
+        std::sort(transients.begin(), transients.end(), [&](Resource a, Resource b)
+        {
+            return requirements[a].size > requirements[b].size;
+        });
+
+        std::vector<MemoryBlock> blocks;
+        for (Resource transient : transients)
+        {
+            const ResourceEntry& resource { _resources[transient] };
+            const VkMemoryRequirements& required { requirements[transient] };
+
+            auto block { std::find_if(blocks.begin(), blocks.end(), [&](const MemoryBlock& candidate)
+            {
+                return (candidate.requirements.memoryTypeBits & required.memoryTypeBits) != 0
+                    && std::all_of(candidate.residents.begin(), candidate.residents.end(), [&](Resource resident)
+                    {
+                        return AreLifetimesDisjoint(resource.firstPass, resource.lastPass, _resources[resident].firstPass, _resources[resident].lastPass);
+                    });
+            }) };
+
+            if (block == blocks.end())
+            {
+                blocks.push_back({ required, {} });
+                block = blocks.end() - 1;
+            }
+
+            // Every resident is bound at offset 0
+            block->requirements.size = std::max(block->requirements.size, required.size);
+            block->requirements.alignment = std::max(block->requirements.alignment, required.alignment);
+            block->requirements.memoryTypeBits &= required.memoryTypeBits;
+            block->residents.push_back(transient);
+        }
+
+        for (const MemoryBlock& block : blocks)
+        {
+            uint32_t memoryType { UINT32_MAX };
+            for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; ++i)
+            {
+                if ((block.requirements.memoryTypeBits & (1 << i))
+                    && (_memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+                {
+                    memoryType = i;
+                    break;
+                }
+            }
+
+            if (memoryType == UINT32_MAX)
+            {
+                throw std::runtime_error("Failed to find a memory type for the render graph images!");
+            }
+
+            VkMemoryAllocateInfo allocInfo {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.allocationSize = block.requirements.size;
+            allocInfo.memoryTypeIndex = memoryType;
+
+            VkDeviceMemory memory;
+            if (vkAllocateMemory(_device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to allocate render graph memory!");
+            }
+            _memoryBlocks.push_back(memory);
+            _transientMemorySize += block.requirements.size;
+
+            for (Resource resident : block.residents)
+            {
+                _resources[resident].memoryBlock = static_cast<uint32_t>(_memoryBlocks.size() - 1);
+                vkBindImageMemory(_device, _resources[resident].image, memory, 0);
+            }
+        }
+    }
+
+    void RenderGraph::PlanBarriers()
+    {
+        // Adds what the use has to wait on to the barrier, then updates the state
+        auto applyUse = [](TrackedState& state, const AccessInfo& info, bool isImage, Resource resource, Barrier& barrier)
+        {
+            bool isLayoutChange { isImage && state.layout != info.layout };
+
+            VkPipelineStageFlags srcStages { 0 };
+            VkAccessFlags srcAccess { 0 };
+            bool needsBarrier { false };
+
+            if (isLayoutChange)
+            {
+                srcStages = state.writeStages | state.readStages;
+                srcAccess = state.writeAccess;
+                needsBarrier = true;
+            }
+            else if (info.isWrite)
+            {
+                // After the reads, which already waited on the last write. Otherwise after the last write.
+                srcStages = state.readStages != 0 ? state.readStages : state.writeStages;
+                srcAccess = state.readStages != 0 ? 0 : state.writeAccess;
+                needsBarrier = srcStages != 0;
+            }
+            else if (state.writeStages != 0)
+            {
+                needsBarrier = (info.stages & ~state.visibleStages) != 0 || (info.access & ~state.visibleAccess) != 0;
+                srcStages = state.writeStages;
+                srcAccess = state.writeAccess;
+            }
+
+            if (needsBarrier)
+            {
+                barrier.srcStages |= srcStages;
+                barrier.dstStages |= info.stages;
+
+                if (isLayoutChange)
+                {
+                    barrier.imageBarriers.push_back({ resource, state.layout, info.layout, srcAccess, info.access });
+                }
+                else
+                {
+                    barrier.srcAccess |= srcAccess;
+                    barrier.dstAccess |= info.access;
+                }
+            }
+
+            if (info.isWrite || isLayoutChange)
+            {
+                // A layout transition is a write as well, visible to this use only
+                state.writeStages = info.stages;
+                state.writeAccess = info.access & WRITE_ACCESS_MASK;
+                state.readStages = info.isWrite ? 0 : info.stages;
+                state.visibleStages = info.stages;
+                state.visibleAccess = info.access;
+            }
+            else
+            {
+                if (needsBarrier)
+                {
+                    state.visibleStages |= info.stages;
+                    state.visibleAccess |= info.access;
+                }
+                state.readStages |= info.stages;
+            }
+
+            if (isImage)
+                state.layout = info.layout;
+        };
+
+        auto isImage = [&](Resource resource)
+        {
+            return _resources[resource].type != RESOURCE_TYPE_IMPORTED_BUFFER;
+        };
+
+        auto simulate = [&](std::vector<TrackedState>& states, bool isPlanning)
+        {
+            for (uint32_t i = 0; i < _passes.size(); ++i)
+            {
+                if (_passes[i].isCulled)
+                    continue;
+
+                Step step {};
+                step.pass = i;
+                for (const Use& use : _passes[i].uses)
+                {
+                    applyUse(states[use.resource], ACCESS_INFOS[use.access], isImage(use.resource), use.resource, step.barrier);
+                }
+
+                if (isPlanning)
+                    _steps.push_back(std::move(step));
+            }
+        };
+
+        TrackedState undefinedState {};
+        undefinedState.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        // The state at the end of a frame is the state at the start of the next one
+        std::vector<TrackedState> finalStates(_resources.size(), undefinedState);
+        simulate(finalStates, false);
+
+        std::vector<TrackedState> states(_resources.size(), undefinedState);
+        for (Resource i = 0; i < _resources.size(); ++i)
+        {
+            const ResourceEntry& resource { _resources[i] };
+
+            if (resource.type == RESOURCE_TYPE_IMPORTED_IMAGE)
+            {
+                states[i].layout = resource.initialState.layout;
+                states[i].writeStages = resource.initialState.stages;
+                states[i].writeAccess = resource.initialState.access;
+            }
+            else if (resource.type == RESOURCE_TYPE_IMPORTED_BUFFER && resource.isPersistent)
+            {
+                states[i] = finalStates[i];
+                states[i].visibleStages = 0;
+                states[i].visibleAccess = 0;
+            }
+            else if (resource.type == RESOURCE_TYPE_TRANSIENT_IMAGE && resource.isUsed)
+            {
+                // Waits on the previous user of the memory : the resident before it in the frame,
+                // or the last one of the previous frame. The content is discarded.
+                auto isResident = [&](Resource other)
+                {
+                    return _resources[other].type == RESOURCE_TYPE_TRANSIENT_IMAGE
+                        && _resources[other].isUsed
+                        && _resources[other].memoryBlock == resource.memoryBlock;
+                };
+
+                Resource previous { i };
+                bool isFound { false };
+                for (Resource j = 0; j < _resources.size(); ++j)
+                {
+                    if (isResident(j) && _resources[j].lastPass < resource.firstPass
+                        && (!isFound || _resources[j].lastPass > _resources[previous].lastPass))
+                    {
+                        previous = j;
+                        isFound = true;
+                    }
+                }
+
+                for (Resource j = 0; j < _resources.size() && !isFound; ++j)
+                {
+                    if (isResident(j) && _resources[j].lastPass > _resources[previous].lastPass)
+                    {
+                        previous = j;
+                    }
+                }
+
+                states[i] = finalStates[previous];
+                states[i].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+                states[i].visibleStages = 0;
+                states[i].visibleAccess = 0;
+            }
+        }
+
+        _steps.clear();
+        simulate(states, true);
+
+        // The imported images are handed back in the layout they are expected in
+        _finalBarrier = {};
+        for (Resource i = 0; i < _resources.size(); ++i)
+        {
+            const ResourceEntry& resource { _resources[i] };
+            if (resource.type != RESOURCE_TYPE_IMPORTED_IMAGE || states[i].layout == resource.finalState.layout)
+                continue;
+
+            _finalBarrier.srcStages |= states[i].writeStages | states[i].readStages;
+            _finalBarrier.dstStages |= resource.finalState.stages;
+            _finalBarrier.imageBarriers.push_back({ i, states[i].layout, resource.finalState.layout, states[i].writeAccess, resource.finalState.access });
+        }
+    }
+
+    void RenderGraph::Execute(VkCommandBuffer commandBuffer) const
+    {
+        for (const Step& step : _steps)
+        {
+            RecordBarrier(commandBuffer, step.barrier);
+            _passes[step.pass].record(commandBuffer);
+        }
+
+        RecordBarrier(commandBuffer, _finalBarrier);
+    }
+
+    void RenderGraph::RecordBarrier(VkCommandBuffer commandBuffer, const Barrier& barrier) const
+    {
+        if (barrier.srcStages == 0 && barrier.dstStages == 0 && barrier.imageBarriers.empty())
+            return;
+
+        VkMemoryBarrier memoryBarrier {};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = barrier.srcAccess;
+        memoryBarrier.dstAccessMask = barrier.dstAccess;
+        uint32_t memoryBarrierCount { (barrier.srcAccess | barrier.dstAccess) != 0 ? 1u : 0u };
+
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        imageBarriers.reserve(barrier.imageBarriers.size());
+        for (const ImageBarrier& planned : barrier.imageBarriers)
+        {
+            const ResourceEntry& resource { _resources[planned.resource] };
+
+            VkImageMemoryBarrier imageBarrier {};
+            imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            imageBarrier.oldLayout = planned.oldLayout;
+            imageBarrier.newLayout = planned.newLayout;
+            imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.image = resource.image;
+            imageBarrier.subresourceRange = { resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+            imageBarrier.srcAccessMask = planned.srcAccess;
+            imageBarrier.dstAccessMask = planned.dstAccess;
+            imageBarriers.push_back(imageBarrier);
+        }
+
+        // Nothing to wait on, or nothing waiting : the ends of the pipeline
+        vkCmdPipelineBarrier(commandBuffer,
+            barrier.srcStages != 0 ? barrier.srcStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT),
+            barrier.dstStages != 0 ? barrier.dstStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT),
+            0,
+            memoryBarrierCount, &memoryBarrier,
+            0, nullptr,
+            static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+    }
+
+    void RenderGraph::Destroy()
+    {
+        for (ResourceEntry& resource : _resources)
+        {
+            if (resource.type == RESOURCE_TYPE_TRANSIENT_IMAGE && resource.image != VK_NULL_HANDLE)
+            {
+                vkDestroyImage(_device, resource.image, nullptr);
+                resource.image = VK_NULL_HANDLE;
+            }
+        }
+
+        for (VkDeviceMemory memory : _memoryBlocks)
+        {
+            vkFreeMemory(_device, memory, nullptr);
+        }
+        _memoryBlocks.clear();
+    }
+}
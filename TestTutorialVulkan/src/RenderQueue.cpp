@@ -0,0 +1,86 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <array>
+
+namespace Vulkan
+{
+    uint64_t RenderQueue::MakeKey(Pass pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+    {
+        auto field = [](uint64_t value, uint32_t bits)
+        {
+            return value & ((uint64_t { 1 } << bits) - 1);
+        };
+
+        // Transparent draws blend over what is behind them, the farthest goes first
+        depth = std::clamp(depth, 0.0f, 1.0f);
+        if (pass == PASS_TRANSPARENT)
+            depth = 1.0f - depth;
+
+        uint64_t depthBits { static_cast<uint64_t>(depth * static_cast<float>((1u << DEPTH_BITS) - 1)) };
+
+        uint64_t key { field(pass, PASS_BITS) };
+
+        // Blending order matters more than state changes, the depth goes right under the pass
+        if (pass == PASS_TRANSPARENT)
+        {
+            key = (key << DEPTH_BITS)    | field(depthBits, DEPTH_BITS);
+            key = (key << PIPELINE_BITS) | field(pipeline, PIPELINE_BITS);
+            key = (key << MATERIAL_BITS) | field(material, MATERIAL_BITS);
+            key = (key << MESH_BITS)     | field(mesh, MESH_BITS);
+            return key;
+        }
+
+        key = (key << PIPELINE_BITS) | field(pipeline, PIPELINE_BITS);
+        key = (key << MATERIAL_BITS) | field(material, MATERIAL_BITS);
+        key = (key << MESH_BITS)     | field(mesh, MESH_BITS);
+        key = (key << DEPTH_BITS)    | field(depthBits, DEPTH_BITS);
+        return key;
+    }
+
+    void RenderQueue::Clear()
+    {
+        _entries.clear();
+        _commands.clear();
+    }
+
+    void RenderQueue::Push(uint64_t key, const RenderCommand& command)
+    {
+        _entries.push_back({ key, static_cast<uint32_t>(_commands.size()) });
+        _commands.push_back(command);
+    }
+
+    void RenderQueue::Sort()
+    {
+        // LSD radix sort, one byte per pass. Counting sort passes are stable.
+        _sortedEntries.resize(_entries.size());
+
+        for (uint32_t shift = 0; shift < 64; shift += 8)
+        {
+            std::array<size_t, 256> offsets {};
+            for (const Entry& entry : _entries)
+            {
+                ++offsets[(entry.key >> shift) & 0xFF];
+            }
+
+            // All the keys share this byte (i.e. unused ids, a single pass), nothing to reorder
+            if (std::find(offsets.begin(), offsets.end(), _entries.size()) != offsets.end())
+                continue;
+
+            size_t offset { 0 };
+            for (size_t& bucket : offsets)
+            {
+                size_t count { bucket };
+                bucket = offset;
+                offset += count;
+            }
+
+            for (const Entry& entry : _entries)
+            {
+                _sortedEntries[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+            }
+
+            _entries.swap(_sortedEntries);
+        }
+    }
+}
@@ -0,0 +1,330 @@
+#include "ShaderManager.h"
+#include "EmbeddedShaders.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace Vulkan
+{
+    namespace
+    {
+        // FNV-1a, only used to name the cache files
+        uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+        {
+            const unsigned char* bytes { static_cast<const unsigned char*>(data) };
+            for (size_t i = 0; i < size; ++i)
+            {
+                hash ^= bytes[i];
+                hash *= 0x100000001b3ull;
+            }
+            return hash;
+        }
+
+        shaderc_shader_kind ToShaderKind(VkShaderStageFlagBits stage)
+        {
+            switch (stage)
+            {
+                case VK_SHADER_STAGE_VERTEX_BIT:                  return shaderc_vertex_shader;
+                case VK_SHADER_STAGE_FRAGMENT_BIT:                return shaderc_fragment_shader;
+                case VK_SHADER_STAGE_COMPUTE_BIT:                 return shaderc_compute_shader;
+                case VK_SHADER_STAGE_GEOMETRY_BIT:                return shaderc_geometry_shader;
+                case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:    return shaderc_tess_control_shader;
+                case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT: return shaderc_tess_evaluation_shader;
+                default:
+                    throw std::invalid_argument("Unsupported shader stage!");
+            }
+        }
+
+        bool IsEnvironmentVariableSet(const char* name)
+        {
+        #ifdef _MSC_VER
+            // getenv is deprecated with SDL checks
+            char* value { nullptr };
+            size_t size { 0 };
+            bool isSet { _dupenv_s(&value, &size, name) == 0 && value != nullptr };
+            free(value);
+            return isSet;
+        #else
+            return std::getenv(name) != nullptr;
+        #endif
+        }
+
+        bool ReadText(const std::filesystem::path& path, std::string& text)
+        {
+            std::ifstream file { path, std::ios::binary };
+            if (!file.is_open())
+                return false;
+
+            std::ostringstream stream;
+            stream << file.rdbuf();
+            text = stream.str();
+            return true;
+        }
+    }
+
+    // Resolves #include "file" relative to the including file and #include <file> relative
+    // to the root shader directory, and records every file it opens as a dependency
+    class ShaderManager::Includer : public shaderc::CompileOptions::IncluderInterface
+    {
+        struct Include
+        {
+            std::string name;
+            std::string content;
+            shaderc_include_result result;
+        };
+
+        std::filesystem::path _rootDirectory;
+        std::vector<std::filesystem::path>& _dependencies;
+
+    public:
+        Includer(const std::filesystem::path& rootDirectory, std::vector<std::filesystem::path>& dependencies)
+            : _rootDirectory { rootDirectory }
+            , _dependencies { dependencies }
+        {
+        }
+
+        shaderc_include_result* GetInclude(
+            const char* requestedSource,
+            shaderc_include_type type,
+            const char* requestingSource,
+            size_t /*includeDepth*/) override
+        {
+            std::filesystem::path directory { type == shaderc_include_type_relative
+                ? std::filesystem::path(requestingSource).parent_path()
+                : _rootDirectory };
+
+            Include* include { new Include {} };
+            std::filesystem::path path { (directory / requestedSource).lexically_normal() };
+
+            if (ReadText(path, include->content))
+            {
+                include->name = path.generic_string();
+                _dependencies.push_back(path);
+            }
+            else
+            {
+                // An empty name with the content as the error message reports a failed include
+                include->content = "Cannot open include file " + path.generic_string();
+            }
+
+            include->result.source_name = include->name.c_str();
+            include->result.source_name_length = include->name.size();
+            include->result.content = include->content.c_str();
+            include->result.content_length = include->content.size();
+            include->result.user_data = include;
+
+            return &include->result;
+        }
+
+        void ReleaseInclude(shaderc_include_result* data) override
+        {
+            delete static_cast<Include*>(data->user_data);
+        }
+    };
+
+    ShaderManager::ShaderManager(const std::string& cacheDirectory)
+        : _cacheDirectory { cacheDirectory }
+        , _isUsingSourceFiles { IsEnvironmentVariableSet("SHADER_HOT_RELOAD") || !HasEmbeddedShaders() }
+    {
+    }
+
+    std::string ShaderManager::MakeKey(const std::string& path, const std::vector<ShaderDefine>& defines)
+    {
+        std::string key { path };
+        for (const ShaderDefine& define : defines)
+        {
+            key += '|' + define.name + '=' + define.value;
+        }
+        return key;
+    }
+
+    ShaderCode ShaderManager::Load(
+        const std::string& path,
+        VkShaderStageFlagBits stage,
+        const std::vector<ShaderDefine>& defines)
+    {
+        std::string key { MakeKey(path, defines) };
+
+        if (!_isUsingSourceFiles)
+        {
+            const EmbeddedShader* embedded { FindEmbeddedShader(key) };
+            if (embedded != nullptr)
+                return { embedded->words, embedded->wordCount, nullptr };
+        }
+
+        auto it { _shaders.find(key) };
+        if (it == _shaders.end())
+        {
+            Shader shader {};
+            shader.path = path;
+            shader.stage = stage;
+            shader.defines = defines;
+
+            if (!Build(shader))
+            {
+                throw std::runtime_error("Failed to compile shader " + path);
+            }
+
+            it = _shaders.emplace(key, std::move(shader)).first;
+        }
+
+        const std::shared_ptr<const std::vector<uint32_t>>& spirv { it->second.spirv };
+        return { spirv->data(), spirv->size(), spirv };
+    }
+
+    bool ShaderManager::Build(Shader& shader)
+    {
+        std::string source;
+        if (!ReadText(shader.path, source))
+        {
+            std::cerr << "Shader manager: cannot open " << shader.path << std::endl;
+            return false;
+        }
+
+        std::vector<std::filesystem::path> dependencies { shader.path };
+
+        shaderc::CompileOptions options;
+        options.SetOptimizationLevel(shaderc_optimization_level_performance);
+        options.SetIncluder(std::make_unique<Includer>(std::filesystem::path(shader.path).parent_path(), dependencies));
+        for (const ShaderDefine& define : shader.defines)
+        {
+            options.AddMacroDefinition(define.name, define.value);
+        }
+
+        shaderc_shader_kind kind { ToShaderKind(shader.stage) };
+
+        // Preprocessing is cheap compared to compilation and folds includes and macros into the text,
+        // so hashing its output is enough to tell whether a cached binary is still valid
+        shaderc::PreprocessedSourceCompilationResult preprocessed { _compiler.PreprocessGlsl(source, kind, shader.path.c_str(), options) };
+        if (preprocessed.GetCompilationStatus() != shaderc_compilation_status_success)
+        {
+            std::cerr << preprocessed.GetErrorMessage();
+            return false;
+        }
+
+        std::string preprocessedSource { preprocessed.cbegin(), preprocessed.cend() };
+        std::string key { MakeKey(shader.path, shader.defines) };
+
+        uint64_t hash { HashBytes(preprocessedSource.data(), preprocessedSource.size()) };
+        hash = HashBytes(key.data(), key.size(), hash);
+        hash = HashBytes(&kind, sizeof(kind), hash);
+
+        char hashName[17];
+        snprintf(hashName, sizeof(hashName), "%016llx", static_cast<unsigned long long>(hash));
+        std::filesystem::path cachePath { _cacheDirectory / (std::string(hashName) + ".spv") };
+
+        std::vector<uint32_t> spirv;
+        if (!ReadCache(cachePath, spirv))
+        {
+            shaderc::SpvCompilationResult result
+            {
+                _compiler.CompileGlslToSpv(preprocessedSource, kind, shader.path.c_str(), options)
+            };
+
+            if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+            {
+                std::cerr << result.GetErrorMessage();
+                return false;
+            }
+
+            spirv.assign(result.cbegin(), result.cend());
+            WriteCache(cachePath, spirv);
+        }
+
+        // Code handed out before keeps the previous words alive
+        shader.spirv = std::make_shared<const std::vector<uint32_t>>(std::move(spirv));
+
+        shader.dependencies.clear();
+        for (const std::filesystem::path& dependency : dependencies)
+        {
+            std::error_code error;
+            shader.dependencies.emplace_back(dependency, std::filesystem::last_write_time(dependency, error));
+        }
+
+        return true;
+    }
+
+    bool ShaderManager::ReadCache(const std::filesystem::path& path, std::vector<uint32_t>& spirv)
+    {
+        std::ifstream file { path, std::ios::ate | std::ios::binary };
+        if (!file.is_open())
+            return false;
+
+        size_t size { static_cast<size_t>(file.tellg()) };
+        if (size == 0 || size % sizeof(uint32_t) != 0)
+            return false;
+
+        spirv.resize(size / sizeof(uint32_t));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(spirv.data()), size);
+
+        // SPIR-V magic number
+        return file.good() && spirv[0] == 0x07230203;
+    }
+
+    void ShaderManager::WriteCache(const std::filesystem::path& path, const std::vector<uint32_t>& spirv)
+    {
+        // Only created when something is compiled, embedded shaders never touch the disk
+        std::error_code error;
+        std::filesystem::create_directories(path.parent_path(), error);
+
+        // Same write-then-rename as the pipeline cache, a partial file is never picked up
+        std::filesystem::path tempPath { path };
+        tempPath += ".tmp";
+
+        {
+            std::ofstream file { tempPath, std::ios::binary | std::ios::trunc };
+            if (!file.is_open())
+                return;
+
+            file.write(reinterpret_cast<const char*>(spirv.data()), spirv.size() * sizeof(uint32_t));
+        }
+
+        std::filesystem::rename(tempPath, path, error);
+    }
+
+    std::vector<std::string> ShaderManager::PollChanges()
+    {
+        std::vector<std::string> changed;
+
+        for (auto& [key, shader] : _shaders)
+        {
+            bool isOutdated { false };
+            for (const auto& [path, writeTime] : shader.dependencies)
+            {
+                std::error_code error;
+                if (std::filesystem::last_write_time(path, error) != writeTime)
+                {
+                    isOutdated = true;
+                    break;
+                }
+            }
+
+            if (!isOutdated)
+                continue;
+
+            // Keep the previous binary when the new source does not compile
+            Shader rebuilt { shader };
+            if (Build(rebuilt))
+            {
+                shader = std::move(rebuilt);
+                changed.push_back(key);
+            }
+            else
+            {
+                // Do not report the same error every poll, wait for the next save
+                for (auto& dependency : shader.dependencies)
+                {
+                    std::error_code error;
+                    dependency.second = std::filesystem::last_write_time(dependency.first, error);
+                }
+            }
+        }
+
+        return changed;
+    }
+}
@@ -0,0 +1,518 @@
+#include "ShaderReflection.h"
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+#include <vulkan/spirv.h>
+
+namespace Vulkan
+{
+    namespace
+    {
+        constexpr uint32_t NO_VALUE { ~0u };
+
+        // What the reflection needs to know about one SPIR-V id
+        struct SpirvId
+        {
+            SpvOp opcode = SpvOpNop;
+            std::string name;
+
+            // Pointee of a pointer, element of an array, component of a vector or matrix,
+            // result type of a variable or constant
+            uint32_t typeId = 0;
+            // Bit width of a scalar, component count of a vector or matrix, id of an array length
+            uint32_t count = 0;
+            uint32_t storageClass = 0;
+            bool isSigned = false;
+            uint32_t imageDim = 0;
+            uint32_t imageSampled = 0;
+            uint32_t constant = 0;
+            std::vector<uint32_t> memberTypes;
+
+            // Decorations
+            uint32_t set = 0;
+            uint32_t binding = NO_VALUE;
+            uint32_t location = NO_VALUE;
+            uint32_t arrayStride = 0;
+            bool isBuiltIn = false;
+            bool isBlock = false;
+            bool isBufferBlock = false;
+            std::vector<uint32_t> memberOffsets;
+            std::vector<uint32_t> memberMatrixStrides;
+        };
+
+        std::string ReadString(const uint32_t* words, size_t wordCount)
+        {
+            // Packed 4 characters per word, little-endian, null-terminated
+            std::string string;
+            for (size_t i = 0; i < wordCount; ++i)
+            {
+                for (int byte = 0; byte < 4; ++byte)
+                {
+                    char character { static_cast<char>((words[i] >> (byte * 8)) & 0xff) };
+                    if (character == '\0')
+                        return string;
+                    string += character;
+                }
+            }
+            return string;
+        }
+
+        void SetMemberValue(std::vector<uint32_t>& values, uint32_t member, uint32_t value)
+        {
+            if (values.size() <= member)
+                values.resize(member + 1, 0);
+            values[member] = value;
+        }
+
+        uint32_t GetTypeSize(const std::vector<SpirvId>& ids, uint32_t typeId, uint32_t matrixStride = 0)
+        {
+            const SpirvId& type { ids[typeId] };
+            switch (type.opcode)
+            {
+                case SpvOpTypeBool:   return 4;
+                case SpvOpTypeInt:
+                case SpvOpTypeFloat:  return type.count / 8;
+                case SpvOpTypeVector: return type.count * GetTypeSize(ids, type.typeId);
+                case SpvOpTypeMatrix: return type.count * (matrixStride != 0 ? matrixStride : GetTypeSize(ids, type.typeId));
+                case SpvOpTypeArray:
+                {
+                    uint32_t stride { type.arrayStride != 0 ? type.arrayStride : GetTypeSize(ids, type.typeId) };
+                    return ids[type.count].constant * stride;
+                }
+                case SpvOpTypeStruct:
+                {
+                    uint32_t size { 0 };
+                    for (size_t member = 0; member < type.memberTypes.size(); ++member)
+                    {
+                        uint32_t offset { member < type.memberOffsets.size() ? type.memberOffsets[member] : 0 };
+                        uint32_t memberMatrixStride { member < type.memberMatrixStrides.size() ? type.memberMatrixStrides[member] : 0 };
+                        size = std::max(size, offset + GetTypeSize(ids, type.memberTypes[member], memberMatrixStride));
+                    }
+                    return size;
+                }
+                default:
+                    return 0;
+            }
+        }
+
+        VkFormat GetVertexFormat(const std::vector<SpirvId>& ids, uint32_t typeId)
+        {
+            const SpirvId& type { ids[typeId] };
+
+            uint32_t componentCount { 1 };
+            const SpirvId* component { &type };
+            if (type.opcode == SpvOpTypeVector)
+            {
+                componentCount = type.count;
+                component = &ids[type.typeId];
+            }
+
+            if (component->count != 32)
+                return VK_FORMAT_UNDEFINED;
+
+            static const VkFormat floatFormats[] { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+            static const VkFormat intFormats[]   { VK_FORMAT_R32_SINT,   VK_FORMAT_R32G32_SINT,   VK_FORMAT_R32G32B32_SINT,   VK_FORMAT_R32G32B32A32_SINT };
+            static const VkFormat uintFormats[]  { VK_FORMAT_R32_UINT,   VK_FORMAT_R32G32_UINT,   VK_FORMAT_R32G32B32_UINT,   VK_FORMAT_R32G32B32A32_UINT };
+
+            if (componentCount < 1 || componentCount > 4)
+                return VK_FORMAT_UNDEFINED;
+
+            if (component->opcode == SpvOpTypeFloat)
+                return floatFormats[componentCount - 1];
+            if (component->opcode == SpvOpTypeInt)
+                return component->isSigned ? intFormats[componentCount - 1] : uintFormats[componentCount - 1];
+
+            return VK_FORMAT_UNDEFINED;
+        }
+
+        // Descriptor type of a resource variable, also unwraps arrays of descriptors
+        VkDescriptorType GetDescriptorType(const std::vector<SpirvId>& ids, const SpirvId& variable, uint32_t& descriptorCount)
+        {
+            uint32_t typeId { ids[variable.typeId].typeId };
+            descriptorCount = 1;
+
+            while (ids[typeId].opcode == SpvOpTypeArray || ids[typeId].opcode == SpvOpTypeRuntimeArray)
+            {
+                if (ids[typeId].opcode == SpvOpTypeRuntimeArray)
+                    throw std::runtime_error("Shader reflection: unsized descriptor arrays are not supported!");
+
+                descriptorCount *= ids[ids[typeId].count].constant;
+                typeId = ids[typeId].typeId;
+            }
+
+            const SpirvId& type { ids[typeId] };
+            switch (type.opcode)
+            {
+                case SpvOpTypeStruct:
+                    if (variable.storageClass == SpvStorageClassStorageBuffer || type.isBufferBlock)
+                        return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                    return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+                case SpvOpTypeSampledImage:
+                    return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+                case SpvOpTypeSampler:
+                    return VK_DESCRIPTOR_TYPE_SAMPLER;
+
+                case SpvOpTypeImage:
+                    // Sampled : 1 is used with a sampler, 2 is read / written without
+                    if (type.imageDim == SpvDimSubpassData)
+                        return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+                    if (type.imageDim == SpvDimBuffer)
+                        return type.imageSampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+                    return type.imageSampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+
+                default:
+                    throw std::runtime_error("Shader reflection: unsupported resource type for " + variable.name + "!");
+            }
+        }
+    }
+
+    ShaderReflection ShaderReflection::Reflect(const uint32_t* spirv, size_t wordCount, VkShaderStageFlagBits stage)
+    {
+        // Header : magic, version, generator, bound, schema
+        if (spirv == nullptr || wordCount < 5 || spirv[0] != SpvMagicNumber)
+            throw std::runtime_error("Shader reflection: invalid SPIR-V!");
+
+        std::vector<SpirvId> ids(spirv[3]);
+        auto getId = [&](uint32_t id) -> SpirvId&
+        {
+            if (id >= ids.size())
+                throw std::runtime_error("Shader reflection: invalid SPIR-V id!");
+            return ids[id];
+        };
+
+        std::vector<uint32_t> variables;
+
+        // ==== Instructions ==== //
+        size_t offset { 5 };
+        while (offset < wordCount)
+        {
+            uint32_t instructionWordCount { spirv[offset] >> SpvWordCountShift };
+            SpvOp opcode { static_cast<SpvOp>(spirv[offset] & SpvOpCodeMask) };
+            const uint32_t* operands { &spirv[offset + 1] };
+
+            if (instructionWordCount == 0 || offset + instructionWordCount > wordCount)
+                throw std::runtime_error("Shader reflection: invalid SPIR-V instruction!");
+
+            switch (opcode)
+            {
+                case SpvOpName:
+                    getId(operands[0]).name = ReadString(operands + 1, instructionWordCount - 2);
+                    break;
+
+                case SpvOpDecorate:
+                {
+                    SpirvId& target { getId(operands[0]) };
+                    switch (operands[1])
+                    {
+                        case SpvDecorationDescriptorSet: target.set = operands[2]; break;
+                        case SpvDecorationBinding:       target.binding = operands[2]; break;
+                        case SpvDecorationLocation:      target.location = operands[2]; break;
+                        case SpvDecorationArrayStride:   target.arrayStride = operands[2]; break;
+                        case SpvDecorationBuiltIn:       target.isBuiltIn = true; break;
+                        case SpvDecorationBlock:         target.isBlock = true; break;
+                        case SpvDecorationBufferBlock:   target.isBufferBlock = true; break;
+                        default: break;
+                    }
+                    break;
+                }
+
+                case SpvOpMemberDecorate:
+                {
+                    SpirvId& target { getId(operands[0]) };
+                    switch (operands[2])
+                    {
+                        case SpvDecorationOffset:       SetMemberValue(target.memberOffsets, operands[1], operands[3]); break;
+                        case SpvDecorationMatrixStride: SetMemberValue(target.memberMatrixStrides, operands[1], operands[3]); break;
+                        case SpvDecorationBuiltIn:      target.isBuiltIn = true; break;
+                        default: break;
+                    }
+                    break;
+                }
+
+                case SpvOpTypeVoid:
+                case SpvOpTypeBool:
+                case SpvOpTypeSampler:
+                    getId(operands[0]).opcode = opcode;
+                    break;
+
+                case SpvOpTypeInt:
+                    getId(operands[0]).opcode = opcode;
+                    ids[operands[0]].count = operands[1];
+                    ids[operands[0]].isSigned = operands[2] != 0;
+                    break;
+
+                case SpvOpTypeFloat:
+                    getId(operands[0]).opcode = opcode;
+                    ids[operands[0]].count = operands[1];
+                    break;
+
+                case SpvOpTypeVector:
+                case SpvOpTypeMatrix:
+                case SpvOpTypeArray:
+                    getId(operands[0]).opcode = opcode;
+                    ids[operands[0]].typeId = operands[1];
+                    ids[operands[0]].count = operands[2];
+                    break;
+
+                case SpvOpTypeRuntimeArray:
+                case SpvOpTypeSampledImage:
+                    getId(operands[0]).opcode = opcode;
+                    ids[operands[0]].typeId = operands[1];
+                    break;
+
+                case SpvOpTypeImage:
+                    getId(operands[0]).opcode = opcode;
+                    ids[operands[0]].typeId = operands[1];
+                    ids[operands[0]].imageDim = operands[2];
+                    ids[operands[0]].imageSampled = operands[6];
+                    break;
+
+                case SpvOpTypeStruct:
+                    getId(operands[0]).opcode = opcode;
+                    ids[operands[0]].memberTypes.assign(operands + 1, operands + instructionWordCount - 1);
+                    break;
+
+                case SpvOpTypePointer:
+                    getId(operands[0]).opcode = opcode;
+                    ids[operands[0]].storageClass = operands[1];
+                    ids[operands[0]].typeId = operands[2];
+                    break;
+
+                case SpvOpConstant:
+                    // Only 32 bits constants are used, as array lengths
+                    getId(operands[1]).opcode = opcode;
+                    ids[operands[1]].typeId = operands[0];
+                    ids[operands[1]].constant = operands[2];
+                    break;
+
+                case SpvOpVariable:
+                    getId(operands[1]).opcode = opcode;
+                    ids[operands[1]].typeId = operands[0];
+                    ids[operands[1]].storageClass = operands[2];
+                    variables.push_back(operands[1]);
+                    break;
+
+                default:
+                    break;
+            }
+
+            offset += instructionWordCount;
+        }
+
+        // ==== Interface ==== //
+        ShaderReflection reflection;
+
+        for (uint32_t variableId : variables)
+        {
+            const SpirvId& variable { ids[variableId] };
+            const SpirvId& pointer { getId(variable.typeId) };
+            uint32_t typeId { pointer.typeId };
+
+            switch (variable.storageClass)
+            {
+                case SpvStorageClassUniform:
+                case SpvStorageClassUniformConstant:
+                case SpvStorageClassStorageBuffer:
+                {
+                    if (variable.binding == NO_VALUE)
+                        break;
+
+                    ShaderBinding binding {};
+                    // Blocks without an instance name are named after their type
+                    binding.name = variable.name.empty() ? ids[typeId].name : variable.name;
+                    binding.set = variable.set;
+                    binding.layoutBinding.binding = variable.binding;
+                    binding.layoutBinding.descriptorType = GetDescriptorType(ids, variable, binding.layoutBinding.descriptorCount);
+                    binding.layoutBinding.stageFlags = stage;
+                    binding.layoutBinding.pImmutableSamplers = nullptr;
+
+                    reflection._bindings.push_back(binding);
+                    break;
+                }
+
+                case SpvStorageClassPushConstant:
+                {
+                    const SpirvId& type { getId(typeId) };
+
+                    VkPushConstantRange range {};
+                    range.stageFlags = stage;
+                    range.offset = type.memberOffsets.empty() ? 0 : *std::min_element(type.memberOffsets.begin(), type.memberOffsets.end());
+                    range.size = GetTypeSize(ids, typeId) - range.offset;
+
+                    reflection._pushConstantRanges.push_back(range);
+                    break;
+                }
+
+                case SpvStorageClassInput:
+                {
+                    if (stage != VK_SHADER_STAGE_VERTEX_BIT || variable.isBuiltIn || ids[typeId].isBuiltIn)
+                        break;
+
+                    ShaderVertexInput input {};
+                    input.name = variable.name;
+                    input.location = variable.location;
+                    input.format = GetVertexFormat(ids, typeId);
+
+                    if (input.format == VK_FORMAT_UNDEFINED)
+                        throw std::runtime_error("Shader reflection: unsupported vertex input type for " + variable.name + "!");
+
+                    reflection._vertexInputs.push_back(input);
+                    break;
+                }
+
+                default:
+                    break;
+            }
+        }
+
+        std::sort(reflection._bindings.begin(), reflection._bindings.end(), [](const ShaderBinding& a, const ShaderBinding& b)
+        {
+            return a.set != b.set ? a.set < b.set : a.layoutBinding.binding < b.layoutBinding.binding;
+        });
+        std::sort(reflection._vertexInputs.begin(), reflection._vertexInputs.end(), [](const ShaderVertexInput& a, const ShaderVertexInput& b)
+        {
+            return a.location < b.location;
+        });
+
+        return reflection;
+    }
+
+    void ShaderReflection::Merge(const ShaderReflection& other)
+    {
+        for (const ShaderBinding& otherBinding : other._bindings)
+        {
+            auto it { std::find_if(_bindings.begin(), _bindings.end(), [&](const ShaderBinding& binding)
+            {
+                return binding.set == otherBinding.set && binding.layoutBinding.binding == otherBinding.layoutBinding.binding;
+            }) };
+
+            if (it == _bindings.end())
+            {
+                _bindings.push_back(otherBinding);
+                continue;
+            }
+
+            if (it->layoutBinding.descriptorType != otherBinding.layoutBinding.descriptorType)
+                throw std::runtime_error("Shader reflection: " + it->name + " and " + otherBinding.name + " share a binding with different types!");
+
+            it->layoutBinding.stageFlags |= otherBinding.layoutBinding.stageFlags;
+            it->layoutBinding.descriptorCount = std::max(it->layoutBinding.descriptorCount, otherBinding.layoutBinding.descriptorCount);
+        }
+
+        std::sort(_bindings.begin(), _bindings.end(), [](const ShaderBinding& a, const ShaderBinding& b)
+        {
+            return a.set != b.set ? a.set < b.set : a.layoutBinding.binding < b.layoutBinding.binding;
+        });
+
+        // A single range covering every stage, pushed with all their stage flags
+        for (const VkPushConstantRange& otherRange : other._pushConstantRanges)
+        {
+            if (_pushConstantRanges.empty())
+            {
+                _pushConstantRanges.push_back(otherRange);
+                continue;
+            }
+
+            VkPushConstantRange& range { _pushConstantRanges.front() };
+            uint32_t end { std::max(range.offset + range.size, otherRange.offset + otherRange.size) };
+            range.stageFlags |= otherRange.stageFlags;
+            range.offset = std::min(range.offset, otherRange.offset);
+            range.size = end - range.offset;
+        }
+
+        for (const ShaderVertexInput& otherInput : other._vertexInputs)
+        {
+            auto it { std::find_if(_vertexInputs.begin(), _vertexInputs.end(), [&](const ShaderVertexInput& input)
+            {
+                return input.location == otherInput.location;
+            }) };
+
+            if (it == _vertexInputs.end())
+                _vertexInputs.push_back(otherInput);
+            else if (it->format != otherInput.format)
+                throw std::runtime_error("Shader reflection: vertex input " + otherInput.name + " is declared with two formats!");
+        }
+
+        std::sort(_vertexInputs.begin(), _vertexInputs.end(), [](const ShaderVertexInput& a, const ShaderVertexInput& b)
+        {
+            return a.location < b.location;
+        });
+    }
+
+    uint32_t ShaderReflection::GetSetCount() const
+    {
+        uint32_t setCount { 0 };
+        for (const ShaderBinding& binding : _bindings)
+        {
+            setCount = std::max(setCount, binding.set + 1);
+        }
+        return setCount;
+    }
+
+    std::vector<VkDescriptorSetLayoutBinding> ShaderReflection::GetSetBindings(uint32_t set) const
+    {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        for (const ShaderBinding& binding : _bindings)
+        {
+            if (binding.set == set)
+                bindings.push_back(binding.layoutBinding);
+        }
+        return bindings;
+    }
+
+    const ShaderBinding& ShaderReflection::FindBinding(const std::string& name) const
+    {
+        auto it { std::find_if(_bindings.begin(), _bindings.end(), [&](const ShaderBinding& binding) { return binding.name == name; }) };
+        if (it == _bindings.end())
+            throw std::runtime_error("Shader reflection: no binding named " + name + "!");
+
+        return *it;
+    }
+
+    std::vector<VkDescriptorPoolSize> ShaderReflection::GetPoolSizes(uint32_t setCopies) const
+    {
+        std::map<VkDescriptorType, uint32_t> descriptorCounts;
+        for (const ShaderBinding& binding : _bindings)
+        {
+            descriptorCounts[binding.layoutBinding.descriptorType] += binding.layoutBinding.descriptorCount * setCopies;
+        }
+
+        std::vector<VkDescriptorPoolSize> poolSizes;
+        for (const auto& [type, count] : descriptorCounts)
+        {
+            poolSizes.push_back({ type, count });
+        }
+        return poolSizes;
+    }
+
+    std::vector<VkDescriptorPoolSize> ShaderReflection::GetPoolSizes(uint32_t setCopies, uint32_t set) const
+    {
+        std::map<VkDescriptorType, uint32_t> descriptorCounts;
+        for (const ShaderBinding& binding : _bindings)
+        {
+            if (binding.set == set)
+                descriptorCounts[binding.layoutBinding.descriptorType] += binding.layoutBinding.descriptorCount * setCopies;
+        }
+
+        std::vector<VkDescriptorPoolSize> poolSizes;
+        for (const auto& [type, count] : descriptorCounts)
+        {
+            poolSizes.push_back({ type, count });
+        }
+        return poolSizes;
+    }
+
+    VkShaderStageFlags ShaderReflection::GetPushConstantStages() const
+    {
+        VkShaderStageFlags stages { 0 };
+        for (const VkPushConstantRange& range : _pushConstantRanges)
+        {
+            stages |= range.stageFlags;
+        }
+        return stages;
+    }
+}
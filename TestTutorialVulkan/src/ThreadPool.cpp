@@ -0,0 +1,57 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace Vulkan
+{
+    ThreadPool::ThreadPool(size_t workerCount)
+    {
+        if (workerCount == 0)
+        {
+            unsigned int hardwareThreads { std::thread::hardware_concurrency() };
+            workerCount = std::max(1u, hardwareThreads > 1 ? hardwareThreads - 1 : 1u);
+        }
+
+        _workers.reserve(workerCount);
+        for (size_t i = 0; i < workerCount; ++i)
+        {
+            _workers.emplace_back(&ThreadPool::WorkerLoop, this);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock { _mutex };
+            _isStopping = true;
+        }
+        _condition.notify_all();
+
+        // Tasks already queued are still run before the workers exit
+        for (std::thread& worker : _workers)
+        {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::WorkerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock { _mutex };
+                _condition.wait(lock, [this]() { return _isStopping || !_tasks.empty(); });
+
+                if (_tasks.empty())
+                    return;
+
+                task = std::move(_tasks.front());
+                _tasks.pop();
+            }
+
+            task();
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Vulkan
+{
+    uint32_t TransformHierarchy::Add(uint32_t parent, const LocalTransform& local)
+    {
+        if (parent != NO_PARENT && parent >= _parents.size())
+        {
+            throw std::runtime_error("Transform parent must be added before its children!");
+        }
+
+        uint32_t node { static_cast<uint32_t>(_parents.size()) };
+
+        _parents.push_back(parent);
+        _positions.push_back(local.position);
+        _rotations.push_back(local.rotation);
+        _scales.push_back(local.scale);
+        _worldMatrices.emplace_back(1.0f);
+        _isDirty.push_back(0);
+
+        MarkDirty(node);
+        return node;
+    }
+
+    void TransformHierarchy::SetLocal(uint32_t node, const LocalTransform& local)
+    {
+        _positions[node] = local.position;
+        _rotations[node] = local.rotation;
+        _scales[node] = local.scale;
+        MarkDirty(node);
+    }
+
+    void TransformHierarchy::SetPosition(uint32_t node, const glm::vec3& position)
+    {
+        _positions[node] = position;
+        MarkDirty(node);
+    }
+
+    void TransformHierarchy::SetRotation(uint32_t node, const glm::quat& rotation)
+    {
+        _rotations[node] = rotation;
+        MarkDirty(node);
+    }
+
+    void TransformHierarchy::SetScale(uint32_t node, const glm::vec3& scale)
+    {
+        _scales[node] = scale;
+        MarkDirty(node);
+    }
+
+    void TransformHierarchy::MarkDirty(uint32_t node)
+    {
+        _isDirty[node] = 1;
+        _firstDirty = std::min(_firstDirty, static_cast<size_t>(node));
+    }
+
+    void TransformHierarchy::Update()
+    {
+        // Parents come first : by the time a node is reached, its parent is up to date
+        // and its dirty flag already says whether the node has to follow it
+        for (size_t node = _firstDirty; node < _parents.size(); ++node)
+        {
+            uint32_t parent { _parents[node] };
+            if (parent != NO_PARENT && _isDirty[parent])
+                _isDirty[node] = 1;
+
+            if (!_isDirty[node])
+                continue;
+
+            // Scale, then rotate, then translate
+            glm::mat4 local { glm::mat4_cast(_rotations[node]) };
+            local[0] *= _scales[node].x;
+            local[1] *= _scales[node].y;
+            local[2] *= _scales[node].z;
+            local[3] = glm::vec4(_positions[node], 1.0f);
+
+            _worldMatrices[node] = parent == NO_PARENT ? local : _worldMatrices[parent] * local;
+        }
+
+        std::fill(_isDirty.begin() + std::min(_firstDirty, _isDirty.size()), _isDirty.end(), 0);
+        _firstDirty = _parents.size();
+    }
+}